@@ -5,232 +5,5145 @@
 #define NOMINMAX
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#include <Pdh.h>
+#include <Psapi.h>
+#include <WinSock2.h>
+#include <WS2tcpip.h>
 #else
+#ifdef __APPLE__
+#include <libproc.h>
+#include <mach/mach_time.h>
+#include <pthread.h>
+#endif
+#include <dirent.h>
+#include <fcntl.h>
+#include <netdb.h>
+#ifdef __APPLE__
+#include <util.h>
+#elif defined(__FreeBSD__)
+#include <libutil.h>
+#else
+#include <pty.h>
+#endif
+#include <poll.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
 #include <termios.h>
 #include <unistd.h>
 #endif
 
-#include <algorithm>
-#include <array>
-#include <atomic>
-#include <chrono>
-#include <cinttypes>
-#include <cmath>
-#include <csignal>
-#include <cstring>
-#include <string_view>
-#include <tuple>
-#include <vector>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <charconv>
+#include <cinttypes>
+#include <climits>
+#include <cmath>
+#include <cerrno>
+#include <csignal>
+#include <cstdarg>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+enum SignalState : uint8_t {
+    SignalState_Sigint = 0x1,
+    SignalState_Sigwinch = 0x2,
+};
+
+enum ColorMode : uint8_t {
+    ColorMode_All = 0,
+    ColorMode_Foreground = 1,
+    ColorMode_Background = 2,
+    ColorMode_None = 3,
+};
+
+enum SinkMode : uint8_t {
+    SinkMode_Console = 0, // the terminal attached to stdout
+    SinkMode_Null = 1,    // /dev/null or NUL
+    SinkMode_Pipe = 2,    // a pipe drained by a child process
+    SinkMode_Discard = 3, // drop the bytes without making any syscall
+    SinkMode_Tty = 4,     // a terminal device opened by path (POSIX only)
+    SinkMode_File = 5,    // a file written in large blocks, for --record
+};
+
+enum DamageMode : uint8_t {
+    DamageMode_Full = 0,       // redraw every row
+    DamageMode_Rows = 1,       // redraw N rows
+    DamageMode_Sparse = 2,     // redraw N randomly chosen cells, each addressed with CUP
+    DamageMode_Scroll = 3,     // append N rows at the bottom, scrolling the rest up
+    DamageMode_Scrollback = 4, // append N rows (default: a screenful) on the main screen buffer, filling its scrollback
+};
+
+enum SyncMode : uint8_t {
+    SyncMode_2026 = 0, // DECSET 2026 (Synchronized Output)
+    SyncMode_None = 1, // no frame boundaries at all
+    SyncMode_Dcs = 2,  // the older DCS = 1 s / DCS = 2 s form of the same
+};
+
+enum Palette : uint8_t {
+    Palette_TrueColor = 0, // 38;2;r;g;b and 48;2;r;g;b
+    Palette_256 = 1,       // 38;5;n and 48;5;n, using the xterm-256 color cube and gray ramp
+    Palette_16 = 2,        // 30-37/90-97 and 40-47/100-107
+};
+
+enum GlyphSet : uint8_t {
+    GlyphSet_Ascii = 0,     // '!' to '~'
+    GlyphSet_Cjk = 1,       // CJK Unified Ideographs, 2 columns wide
+    GlyphSet_Combining = 2, // a latin letter with 1 or 2 combining diacritical marks
+    GlyphSet_Emoji = 3,     // ZWJ emoji sequences like U+1F469 U+1F3FD U+200D U+1F4BB, 2 columns wide
+    GlyphSet_Mixed = 4,     // a random mix of all of the above
+};
+
+static constexpr size_t color_mode_count = ColorMode_None + 1;
+static constexpr size_t glyph_set_count = GlyphSet_Mixed + 1;
+
+enum SgrMode : uint8_t {
+    SgrMode_Full = 0,    // a complete SGR sequence before every cell
+    SgrMode_Minimal = 1, // only the colors that changed since the previous cell, if any
+};
+
+// The attributes --attrs mixes into the cells, as a bitmask.
+enum Attribute : uint8_t {
+    Attribute_Bold = 1,           // SGR 1
+    Attribute_Italic = 2,         // SGR 3
+    Attribute_Underline = 4,      // SGR 4:3, a curly underline
+    Attribute_UnderlineColor = 8, // SGR 58, colored like the cell's complement
+    Attribute_Hyperlink = 16,     // OSC 8, with a distinct URL per cell
+    Attribute_All = 31,
+};
+
+#ifdef _WIN32
+// Mirrors the POSIX struct, so that the frame composition code can be shared.
+struct iovec {
+    void* iov_base;
+    size_t iov_len;
+};
+
+static const HANDLE consoleHandles[2]{
+    GetStdHandle(STD_INPUT_HANDLE),
+    GetStdHandle(STD_OUTPUT_HANDLE),
+};
+#endif
+
+static std::atomic<uint8_t> signal_state{SignalState_Sigwinch};
+
+struct Sink {
+    SinkMode mode = SinkMode_Console;
+#ifdef _WIN32
+    HANDLE handle = consoleHandles[1];
+    HANDLE process = nullptr;
+#else
+    int fd = STDOUT_FILENO;
+    pid_t pid = 0;
+#endif
+    // SinkMode_File bypasses the page cache (O_DIRECT or FILE_FLAG_NO_BUFFERING).
+    bool direct = false;
+    // Held while a frame is written in several syscalls, so that the bands of other --streams
+    // sharing this sink can't land in between, e.g. in the middle of an escape sequence.
+    mutable std::mutex mutex;
+};
+
+// Where frames go, unless a stream has been given a terminal of its own via --stream-ttys.
+static Sink console_sink;
+
+// Counts the write syscalls of all sinks, so that short writes don't go unnoticed.
+struct IoCounters {
+    using clock = std::chrono::steady_clock;
+
+    std::atomic<uint64_t> writes{0};
+    // Writes that returned less than requested and had to be continued.
+    std::atomic<uint64_t> partial_writes{0};
+    // Writes that failed, which drops the rest of the data.
+    std::atomic<uint64_t> failed_writes{0};
+    // The time spent inside the write syscalls, summed over all threads.
+    std::atomic<uint64_t> blocked_ns{0};
+
+    void reset() noexcept {
+        writes.store(0, std::memory_order_relaxed);
+        partial_writes.store(0, std::memory_order_relaxed);
+        failed_writes.store(0, std::memory_order_relaxed);
+        blocked_ns.store(0, std::memory_order_relaxed);
+    }
+
+    // Called after each syscall with the number of bytes requested and written or -1, and when it started.
+    void record(size_t requested, ptrdiff_t written, clock::time_point beg) noexcept {
+        blocked_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - beg).count(), std::memory_order_relaxed);
+        writes.fetch_add(1, std::memory_order_relaxed);
+        if (written < 0) {
+            failed_writes.fetch_add(1, std::memory_order_relaxed);
+        } else if (size_t(written) < requested) {
+            partial_writes.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+};
+
+static IoCounters io_counters;
+
+// The CPU time this process has spent so far, in seconds.
+struct CpuTimes {
+    double user = 0;
+    double sys = 0;
+};
+
+static CpuTimes query_cpu_times() noexcept {
+    CpuTimes times;
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        // FILETIMEs are in units of 100ns.
+        const auto seconds = [](const FILETIME& t) {
+            return double((uint64_t(t.dwHighDateTime) << 32) | t.dwLowDateTime) / 1e7;
+        };
+        times.user = seconds(user);
+        times.sys = seconds(kernel);
+    }
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        times.user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+        times.sys = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    }
+#endif
+    return times;
+}
+
+// A snapshot of the CPU time and I/O counters, which tells how the time between two of them was spent.
+struct Accounting {
+    std::chrono::steady_clock::time_point time;
+    CpuTimes cpu;
+    uint64_t writes = 0;
+    uint64_t blocked_ns = 0;
+
+    static Accounting now() noexcept {
+        return {
+            std::chrono::steady_clock::now(),
+            query_cpu_times(),
+            io_counters.writes.load(std::memory_order_relaxed),
+            io_counters.blocked_ns.load(std::memory_order_relaxed),
+        };
+    }
+};
+
+// Writes all of the data in a single syscall, unless it's short, in which case it's continued.
+static void write_all(const Sink& sink, const char* data, size_t size) noexcept {
+    while (size) {
+#ifdef _WIN32
+        DWORD written = 0;
+        const auto beg = IoCounters::clock::now();
+        const auto requested = static_cast<DWORD>(std::min<size_t>(size, UINT32_MAX));
+        const auto ok = sink.mode == SinkMode_Console ? WriteConsoleA(sink.handle, data, requested, &written, nullptr) : WriteFile(sink.handle, data, requested, &written, nullptr);
+        io_counters.record(size, ok ? ptrdiff_t(written) : -1, beg);
+        if (!ok || !written) {
+            return;
+        }
+#else
+        const auto beg = IoCounters::clock::now();
+        const auto written = write(sink.fd, data, size);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        io_counters.record(size, written, beg);
+        if (written <= 0) {
+            return;
+        }
+#endif
+        data += written;
+        size -= written;
+    }
+}
+
+// Collects the output for SinkMode_File and writes it in blocks of `capacity` bytes. The buffer and block size
+// are aligned, as unbuffered I/O requires. Only the tail written by close_sink() may need to be padded.
+struct FileBuffer {
+    static constexpr size_t alignment = 4096;
+    static constexpr size_t capacity = 4 * 1024 * 1024;
+
+    char* data = nullptr;
+    size_t size = 0;
+    uint64_t total = 0;
+
+    void append(const Sink& sink, const char* p, size_t length) noexcept {
+        if (!data) {
+            data = static_cast<char*>(operator new(capacity, std::align_val_t{alignment}));
+        }
+        total += length;
+        while (length) {
+            const auto take = std::min(length, capacity - size);
+            memcpy(data + size, p, take);
+            size += take;
+            p += take;
+            length -= take;
+            if (size == capacity) {
+                write_all(sink, data, size);
+                size = 0;
+            }
+        }
+    }
+};
+
+static FileBuffer file_buffer;
+
+// Writes the data in syscalls of at most `chunk` bytes, unless it's 0. The caller holds sink.mutex.
+static void write_chunks(const Sink& sink, const char* data, size_t size, size_t chunk) noexcept {
+    const auto limit = chunk ? chunk : size;
+    for (size_t i = 0; i < size; i += limit) {
+        write_all(sink, data + i, std::min(limit, size - i));
+    }
+}
+
+// Writes the data to the sink in syscalls of at most `chunk` bytes, unless it's 0.
+static void write_console(const Sink& sink, const std::string_view& s, size_t chunk = 0) noexcept {
+    if (sink.mode == SinkMode_Discard) {
+        return;
+    }
+    if (sink.mode == SinkMode_File) {
+        file_buffer.append(sink, s.data(), s.size());
+        return;
+    }
+    // Even a single write may come back short and need more syscalls, so the mutex
+    // is always held to keep the frames of streams sharing the sink from interleaving.
+    const std::lock_guard lock{sink.mutex};
+    write_chunks(sink, s.data(), s.size(), chunk);
+}
+
+static void write_console(const std::string_view& s) noexcept {
+    write_console(console_sink, s);
+}
+
+#ifndef _WIN32
+// Like write_all() but for writev(). The iovecs are modified if the write is short.
+static void writev_all(const Sink& sink, iovec* iov, size_t count, size_t size) noexcept {
+    while (count) {
+        const auto beg = IoCounters::clock::now();
+        const auto written = writev(sink.fd, iov, static_cast<int>(count));
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        io_counters.record(size, written, beg);
+        if (written <= 0) {
+            return;
+        }
+
+        // Skip what got written and continue in the middle of the piece it stopped at.
+        size -= written;
+        auto remaining = size_t(written);
+        while (count && remaining >= iov->iov_len) {
+            remaining -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + remaining;
+            iov->iov_len -= remaining;
+        }
+    }
+}
+#endif
+
+// Writes the given pieces without concatenating them first, in syscalls of at most `chunk` bytes.
+static void write_console_gather(const Sink& sink, const iovec* iov, size_t count, size_t chunk = 0) noexcept {
+    if (sink.mode == SinkMode_Discard) {
+        return;
+    }
+    if (sink.mode == SinkMode_File) {
+        for (size_t i = 0; i < count; ++i) {
+            file_buffer.append(sink, static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+        }
+        return;
+    }
+#ifdef _WIN32
+    // Neither consoles nor pipes support scatter/gather I/O on Windows (WriteFileGather
+    // only works for unbuffered files), so the closest we can get is one write per piece.
+    const std::lock_guard lock{sink.mutex};
+    for (size_t i = 0; i < count; ++i) {
+        write_chunks(sink, static_cast<const char*>(iov[i].iov_base), iov[i].iov_len, chunk);
+    }
+#else
+#ifdef IOV_MAX
+    static constexpr size_t max_count = IOV_MAX;
+#else
+    static constexpr size_t max_count = 1024;
+#endif
+    const auto limit = chunk ? chunk : SIZE_MAX;
+    // Like in write_console(), the sink's mutex holds the frame together across short writes.
+    const std::lock_guard lock{sink.mutex};
+    iovec batch[max_count];
+    size_t batch_count = 0;
+    size_t batch_size = 0;
+
+    // Splits the pieces into batches of at most max_count pieces and `limit` bytes.
+    for (size_t i = 0; i < count; ++i) {
+        auto data = static_cast<char*>(iov[i].iov_base);
+        auto size = iov[i].iov_len;
+        while (size) {
+            const auto take = std::min(size, limit - batch_size);
+            batch[batch_count++] = {data, take};
+            batch_size += take;
+            data += take;
+            size -= take;
+            if (batch_size == limit || batch_count == max_count) {
+                writev_all(sink, &batch[0], batch_count, batch_size);
+                batch_count = 0;
+                batch_size = 0;
+            }
+        }
+    }
+    if (batch_count) {
+        writev_all(sink, &batch[0], batch_count, batch_size);
+    }
+#endif
+}
+
+#ifdef _WIN32
+// The read end of the pipe sink is drained by a copy of ourselves, started with "--drain".
+static int drain_stdin() noexcept {
+    static char buffer[1024 * 1024];
+    const auto input = GetStdHandle(STD_INPUT_HANDLE);
+    DWORD read;
+    while (ReadFile(input, &buffer[0], sizeof(buffer), &read, nullptr) && read) {
+    }
+    return 0;
+}
+#endif
+
+// `path` is only used by SinkMode_Tty and SinkMode_File.
+static bool open_sink(Sink& sink, const char* path = nullptr) noexcept {
+    switch (sink.mode) {
+    case SinkMode_File:
+#ifdef _WIN32
+        sink.handle = CreateFileA(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, sink.direct ? FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH : FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        return sink.handle != INVALID_HANDLE_VALUE;
+#else
+#ifdef O_DIRECT
+        if (sink.direct) {
+            sink.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+            if (sink.fd != -1) {
+                return true;
+            }
+            // Some file systems, like tmpfs, don't support O_DIRECT.
+            sink.direct = false;
+        }
+#else
+        sink.direct = false;
+#endif
+        sink.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        return sink.fd != -1;
+#endif
+    case SinkMode_Null:
+#ifdef _WIN32
+        sink.handle = CreateFileW(L"NUL", GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+        return sink.handle != INVALID_HANDLE_VALUE;
+#else
+        sink.fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        return sink.fd != -1;
+#endif
+    case SinkMode_Pipe: {
+#ifdef _WIN32
+        SECURITY_ATTRIBUTES sa{sizeof(sa), nullptr, TRUE};
+        HANDLE read;
+        if (!CreatePipe(&read, &sink.handle, &sa, 0)) {
+            return false;
+        }
+        SetHandleInformation(sink.handle, HANDLE_FLAG_INHERIT, 0);
+
+        wchar_t path[MAX_PATH];
+        GetModuleFileNameW(nullptr, &path[0], MAX_PATH);
+        std::wstring cmdline;
+        cmdline.append(L"\"");
+        cmdline.append(&path[0]);
+        cmdline.append(L"\" --drain");
+
+        STARTUPINFOW si{};
+        si.cb = sizeof(si);
+        si.dwFlags = STARTF_USESTDHANDLES;
+        si.hStdInput = read;
+        PROCESS_INFORMATION pi{};
+        const auto ok = CreateProcessW(&path[0], cmdline.data(), nullptr, nullptr, TRUE, CREATE_NO_WINDOW, nullptr, nullptr, &si, &pi);
+        CloseHandle(read);
+        if (!ok) {
+            return false;
+        }
+        CloseHandle(pi.hThread);
+        sink.process = pi.hProcess;
+        return true;
+#else
+        int fds[2];
+        if (pipe(fds) != 0) {
+            return false;
+        }
+        sink.pid = fork();
+        if (sink.pid == 0) {
+            // The child shares our process group and would otherwise
+            // exit on ^C before we're done writing into the pipe.
+            signal(SIGINT, SIG_IGN);
+            close(fds[1]);
+            static char buffer[1024 * 1024];
+            while (read(fds[0], &buffer[0], sizeof(buffer)) > 0) {
+            }
+            _exit(0);
+        }
+        close(fds[0]);
+        sink.fd = fds[1];
+        return sink.pid != -1;
+#endif
+    }
+    case SinkMode_Tty:
+#ifdef _WIN32
+        return false;
+#else
+        sink.fd = open(path, O_WRONLY | O_NOCTTY | O_CLOEXEC);
+        return sink.fd != -1;
+#endif
+    default:
+        return true;
+    }
+}
+
+static void close_sink(Sink& sink) noexcept {
+    if (sink.mode == SinkMode_Console || sink.mode == SinkMode_Discard) {
+        return;
+    }
+    if (sink.mode == SinkMode_File && file_buffer.size) {
+        if (sink.direct) {
+            // Unbuffered writes must be a multiple of the alignment,
+            // so the tail gets padded and the file truncated afterwards.
+            const auto padded = (file_buffer.size + FileBuffer::alignment - 1) / FileBuffer::alignment * FileBuffer::alignment;
+            memset(file_buffer.data + file_buffer.size, 0, padded - file_buffer.size);
+            write_all(sink, file_buffer.data, padded);
+#ifdef _WIN32
+            FILE_END_OF_FILE_INFO eof{};
+            eof.EndOfFile.QuadPart = static_cast<LONGLONG>(file_buffer.total);
+            SetFileInformationByHandle(sink.handle, FileEndOfFileInfo, &eof, sizeof(eof));
+#else
+            ftruncate(sink.fd, static_cast<off_t>(file_buffer.total));
+#endif
+        } else {
+            write_all(sink, file_buffer.data, file_buffer.size);
+        }
+        file_buffer.size = 0;
+    }
+#ifdef _WIN32
+    CloseHandle(sink.handle);
+    if (sink.process) {
+        WaitForSingleObject(sink.process, INFINITE);
+        CloseHandle(sink.process);
+    }
+#else
+    close(sink.fd);
+    if (sink.pid > 0) {
+        waitpid(sink.pid, nullptr, 0);
+    }
+#endif
+}
+
+// Like snprintf(), but appends to the buffer [p, end) and advances p, truncating if needed.
+static void format_append(char*& p, char* end, const char* format, ...) noexcept {
+    if (p >= end) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    const auto length = vsnprintf(p, end - p, format, args);
+    va_end(args);
+    p += std::clamp<ptrdiff_t>(length, 0, end - p - 1);
+}
+
+// Returns the value of "name=value" arguments, or nullptr if arg isn't the named option.
+static const char* option_value(const char* arg, const char* name) noexcept {
+    const auto length = strlen(name);
+    return strncmp(arg, name, length) == 0 && arg[length] == '=' ? arg + length + 1 : nullptr;
+}
+
+#ifdef _WIN32
+BOOL WINAPI signalHandler(DWORD) {
+    signal_state.fetch_or(SignalState_Sigint, std::memory_order_relaxed);
+    return TRUE;
+}
+#else
+static void signalHandler(int sig) {
+    switch (sig) {
+    case SIGWINCH:
+        signal_state.fetch_or(SignalState_Sigwinch, std::memory_order_relaxed);
+        break;
+    default:
+        signal_state.fetch_or(SignalState_Sigint, std::memory_order_relaxed);
+        break;
+    }
+}
+#endif
+
+struct RGB {
+    uint8_t r, g, b;
+};
+
+// A color of the rainbow. For Palette_256 and Palette_16 `index` is its palette entry
+// and `rgb` that entry's approximate value in the default xterm palette.
+struct Color {
+    RGB rgb;
+    uint8_t index;
+};
+
+// A log-linear histogram in the spirit of HdrHistogram. Values are bucketed by their most
+// significant bit and then linearly into 2^sub_bits sub-buckets, which bounds the relative
+// error of any reported percentile to 1/2^sub_bits (~3%) over the entire uint64_t range.
+struct Histogram {
+    static constexpr int sub_bits = 5;
+    static constexpr size_t sub_count = size_t{1} << sub_bits;
+    static constexpr size_t bucket_count = (64 - sub_bits + 1) * sub_count;
+
+    std::array<uint64_t, bucket_count> counts{};
+    uint64_t count = 0;
+    uint64_t max = 0;
+    double sum = 0;
+    double sum_sq = 0;
+
+    static size_t index_of(uint64_t value) noexcept {
+        if (value < sub_count) {
+            return static_cast<size_t>(value);
+        }
+        const auto shift = std::bit_width(value) - 1 - sub_bits;
+        return (shift + 1) * sub_count + static_cast<size_t>((value >> shift) - sub_count);
+    }
+
+    // Returns the highest value that's still part of the bucket at the given index.
+    static uint64_t value_of(size_t index) noexcept {
+        if (index < sub_count) {
+            return index;
+        }
+        const auto shift = index / sub_count - 1;
+        const auto lowest = static_cast<uint64_t>(index % sub_count + sub_count) << shift;
+        return lowest + (uint64_t{1} << shift) - 1;
+    }
+
+    void record(uint64_t value) noexcept {
+        counts[index_of(value)]++;
+        count++;
+        max = std::max(max, value);
+        sum += double(value);
+        sum_sq += double(value) * double(value);
+    }
+
+    void merge(const Histogram& other) noexcept {
+        for (size_t i = 0; i < bucket_count; ++i) {
+            counts[i] += other.counts[i];
+        }
+        count += other.count;
+        max = std::max(max, other.max);
+        sum += other.sum;
+        sum_sq += other.sum_sq;
+    }
+
+    void reset() noexcept {
+        *this = {};
+    }
+
+    // p is in the range [0, 100].
+    uint64_t percentile(double p) const noexcept {
+        if (count == 0) {
+            return 0;
+        }
+        const auto target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p / 100.0 * double(count))));
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < bucket_count; ++i) {
+            cumulative += counts[i];
+            if (cumulative >= target) {
+                return std::min(value_of(i), max);
+            }
+        }
+        return max;
+    }
+
+    double mean() const noexcept {
+        return count ? sum / double(count) : 0;
+    }
+
+    // We report the standard deviation of the frame times as their "jitter".
+    double stddev() const noexcept {
+        if (count < 2) {
+            return 0;
+        }
+        const auto m = mean();
+        return std::sqrt(std::max(0.0, sum_sq / double(count) - m * m));
+    }
+};
+
+// Decimal representations of all uint8_t values, so that SGR sequences can be
+// assembled with plain stores instead of going through snprintf for every cell.
+struct DecimalU8 {
+    char digits[4];
+    uint8_t length;
+};
+
+static constexpr auto decimal_u8_table = [] {
+    std::array<DecimalU8, 256> table{};
+    for (int i = 0; i < 256; ++i) {
+        auto& e = table[i];
+        if (i >= 100) {
+            e.digits[e.length++] = static_cast<char>('0' + i / 100);
+        }
+        if (i >= 10) {
+            e.digits[e.length++] = static_cast<char>('0' + i / 10 % 10);
+        }
+        e.digits[e.length++] = static_cast<char>('0' + i % 10);
+    }
+    return table;
+}();
+
+// Writes the decimal representation of v. Always stores 4 bytes, but only advances by
+// the length of the number, so the caller must ensure that there's some slack at the end.
+static char* encode_u8(char* p, uint8_t v) noexcept {
+    const auto& e = decimal_u8_table[v];
+    memcpy(p, &e.digits[0], 4);
+    return p + e.length;
+}
+
+template<size_t N>
+static char* encode_literal(char* p, const char (&str)[N]) noexcept {
+    memcpy(p, &str[0], N - 1);
+    return p + N - 1;
+}
+
+// Writes the codepoint as 1 to 4 bytes of UTF-8.
+static char* encode_utf8(char* p, uint32_t cp) noexcept {
+    if (cp < 0x80) {
+        *p++ = static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        *p++ = static_cast<char>(0xc0 | (cp >> 6));
+        *p++ = static_cast<char>(0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+        *p++ = static_cast<char>(0xe0 | (cp >> 12));
+        *p++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+        *p++ = static_cast<char>(0x80 | (cp & 0x3f));
+    } else {
+        *p++ = static_cast<char>(0xf0 | (cp >> 18));
+        *p++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+        *p++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+        *p++ = static_cast<char>(0x80 | (cp & 0x3f));
+    }
+    return p;
+}
+
+// Writes "r;g;b".
+static char* encode_rgb(char* p, const RGB& c) noexcept {
+    p = encode_u8(p, c.r);
+    *p++ = ';';
+    p = encode_u8(p, c.g);
+    *p++ = ';';
+    return encode_u8(p, c.b);
+}
+
+// Returns the length of what encode_rgb() writes.
+static size_t rgb_length(const RGB& c) noexcept {
+    return decimal_u8_table[c.r].length + decimal_u8_table[c.g].length + decimal_u8_table[c.b].length + 2;
+}
+
+// Writes the SGR parameters for the given color, e.g. "48;2;r;g;b".
+static char* encode_color(char* p, Palette palette, const Color& c, bool foreground) noexcept {
+    switch (palette) {
+    case Palette_256:
+        p = foreground ? encode_literal(p, "38;5;") : encode_literal(p, "48;5;");
+        return encode_u8(p, c.index);
+    case Palette_16:
+        return encode_u8(p, static_cast<uint8_t>((c.index < 8 ? 30 : 90 - 8) + (foreground ? 0 : 10) + c.index));
+    default:
+        p = foreground ? encode_literal(p, "38;2;") : encode_literal(p, "48;2;");
+        return encode_rgb(p, c.rgb);
+    }
+}
+
+// Returns the length of what encode_color() writes.
+static size_t color_length(Palette palette, const Color& c, bool foreground) noexcept {
+    switch (palette) {
+    case Palette_256:
+        return strlen("38;5;") + decimal_u8_table[c.index].length;
+    case Palette_16:
+        return !foreground && c.index >= 8 ? 3 : 2;
+    default:
+        return strlen("38;2;") + rgb_length(c.rgb);
+    }
+}
+
+// Writes the SGR sequence setting the given colors. Either may be null to leave it unchanged.
+static char* encode_sgr(char* p, Palette palette, const Color* bg, const Color* fg) noexcept {
+    if (!bg && !fg) {
+        return p;
+    }
+    p = encode_literal(p, "\x1b[");
+    if (bg) {
+        p = encode_color(p, palette, *bg, false);
+    }
+    if (bg && fg) {
+        *p++ = ';';
+    }
+    if (fg) {
+        p = encode_color(p, palette, *fg, true);
+    }
+    *p++ = 'm';
+    return p;
+}
+
+// Returns the length of what encode_sgr() writes.
+static size_t sgr_length(Palette palette, const Color* bg, const Color* fg) noexcept {
+    if (!bg && !fg) {
+        return 0;
+    }
+    size_t length = strlen("\x1b[m");
+    if (bg) {
+        length += color_length(palette, *bg, false);
+    }
+    if (bg && fg) {
+        length += 1;
+    }
+    if (fg) {
+        length += color_length(palette, *fg, true);
+    }
+    return length;
+}
+
+// The names of the attributes in the order of their bits, as used by --attrs.
+static constexpr std::string_view attribute_names[]{"bold", "italic", "underline", "ulcolor", "link"};
+
+// The URL prefix of the --attrs hyperlinks. Each cell appends its index.
+static constexpr std::string_view hyperlink_prefix{"\x1b]8;;https://example.com/"};
+
+// Writes the sequence that enables the given attributes for a single cell, which is followed by the cell's glyph
+// and then encode_attributes_off(). `ul` is the underline color and `link` the hyperlink's distinct number.
+static char* encode_attributes_on(char* p, Palette palette, uint8_t attributes, const Color& ul, size_t link) noexcept {
+    static constexpr std::string_view params[]{"1;", "3;", "4:3;"};
+
+    if (attributes & ~Attribute_Hyperlink) {
+        p = encode_literal(p, "\x1b[");
+        for (size_t k = 0; k < std::size(params); ++k) {
+            if (attributes & (1 << k)) {
+                memcpy(p, params[k].data(), params[k].size());
+                p += params[k].size();
+            }
+        }
+        if (attributes & Attribute_UnderlineColor) {
+            if (palette == Palette_TrueColor) {
+                p = encode_rgb(encode_literal(p, "58;2;"), ul.rgb);
+            } else {
+                p = encode_u8(encode_literal(p, "58;5;"), ul.index);
+            }
+            *p++ = ';';
+        }
+        // Replace the trailing ';'.
+        p[-1] = 'm';
+    }
+    if (attributes & Attribute_Hyperlink) {
+        memcpy(p, hyperlink_prefix.data(), hyperlink_prefix.size());
+        p = std::to_chars(p + hyperlink_prefix.size(), p + hyperlink_prefix.size() + 20, link).ptr;
+        p = encode_literal(p, "\x1b\\");
+    }
+    return p;
+}
+
+// Writes the sequence that resets the attributes enabled by encode_attributes_on(),
+// so that every cell stays self-contained no matter where a slice begins or ends.
+static char* encode_attributes_off(char* p, uint8_t attributes) noexcept {
+    static constexpr std::string_view params[]{"22;", "23;", "24;", "59;"};
+
+    if (attributes & ~Attribute_Hyperlink) {
+        p = encode_literal(p, "\x1b[");
+        for (size_t k = 0; k < std::size(params); ++k) {
+            if (attributes & (1 << k)) {
+                memcpy(p, params[k].data(), params[k].size());
+                p += params[k].size();
+            }
+        }
+        p[-1] = 'm';
+    }
+    if (attributes & Attribute_Hyperlink) {
+        p = encode_literal(p, "\x1b]8;;\x1b\\");
+    }
+    return p;
+}
+
+// Returns the combined length of what encode_attributes_on() and encode_attributes_off() write.
+static size_t attributes_length(Palette palette, uint8_t attributes, const Color& ul, size_t link) noexcept {
+    char buffer[128];
+    const auto on = encode_attributes_on(&buffer[0], palette, attributes, ul, link);
+    return encode_attributes_off(on, attributes) - &buffer[0];
+}
+
+// Formats a --chunk size as e.g. "64K", "1M" or "1500B", or as "unlimited" if it's 0.
+static const char* format_chunk(char (&buffer)[32], size_t chunk) noexcept {
+    if (!chunk) {
+        snprintf(&buffer[0], std::size(buffer), "unlimited");
+    } else if (chunk % (1 << 20) == 0) {
+        snprintf(&buffer[0], std::size(buffer), "%zuM", chunk >> 20);
+    } else if (chunk % (1 << 10) == 0) {
+        snprintf(&buffer[0], std::size(buffer), "%zuK", chunk >> 10);
+    } else {
+        snprintf(&buffer[0], std::size(buffer), "%zuB", chunk);
+    }
+    return &buffer[0];
+}
+
+// Summarizes a histogram of nanosecond values as milliseconds into the given buffer.
+static int format_latencies(char* buffer, size_t size, const Histogram& h) noexcept {
+    return snprintf(
+        buffer,
+        size,
+        "p50 %.2f | p90 %.2f | p99 %.2f | p99.9 %.2f | max %.2f | jitter %.2f ms",
+        h.percentile(50) / 1e6,
+        h.percentile(90) / 1e6,
+        h.percentile(99) / 1e6,
+        h.percentile(99.9) / 1e6,
+        h.max / 1e6,
+        h.stddev() / 1e6
+    );
+}
+
+// Throughput and frame time statistics over a 1s window and over the entire run.
+struct Stats {
+    using clock = std::chrono::steady_clock;
+
+    clock::time_point start = clock::now();
+    clock::time_point reference = start;
+    // The end of the last recorded frame.
+    clock::time_point end = start;
+    // Frames before this point in time show up live, but don't count towards the totals.
+    // Once it's reached all stats are reset and `start` is moved here.
+    clock::time_point warmup_end = start;
+    // Written by whichever thread records the frames, which is the writer thread with --pipeline,
+    // but also read by the stream thread, which discards its own measurements during the warmup.
+    std::atomic<bool> warm{true};
+    // frame_times covers the current window and is shown live,
+    // total_frame_times covers the run up until the current window.
+    Histogram frame_times;
+    Histogram total_frame_times;
+    size_t written = 0;
+    size_t frames = 0;
+    size_t cells = 0;
+    size_t total_written = 0;
+    size_t total_cells = 0;
+
+    // The results of the last completed window.
+    float mbps = 0;
+    float fps = 0;
+    float mcps = 0;
+    float p50_ms = 0;
+    float p99_ms = 0;
+    float max_ms = 0;
+    char latencies[128]{};
+
+    // Returns true whenever a window was completed and the results above got updated.
+    bool record(size_t size, size_t frame_cells, clock::time_point write_beg, clock::time_point write_end) noexcept {
+        if (!warm.load(std::memory_order_relaxed) && write_end >= warmup_end) {
+            frame_times.reset();
+            total_frame_times.reset();
+            written = frames = cells = 0;
+            total_written = total_cells = 0;
+            start = reference = end = write_end;
+            warm.store(true, std::memory_order_release);
+            return false;
+        }
+
+        end = write_end;
+        frame_times.record(std::chrono::duration_cast<std::chrono::nanoseconds>(write_end - write_beg).count());
+        written += size;
+        frames++;
+        cells += frame_cells;
+
+        const auto duration = write_end - reference;
+        if (duration < std::chrono::seconds(1)) {
+            return false;
+        }
+
+        const auto durationCount = std::chrono::duration<float>(duration).count();
+        mbps = written / durationCount / 1e6f;
+        fps = frames / durationCount;
+        mcps = cells / durationCount / 1e6f;
+        p50_ms = static_cast<float>(frame_times.percentile(50) / 1e6);
+        p99_ms = static_cast<float>(frame_times.percentile(99) / 1e6);
+        max_ms = static_cast<float>(frame_times.max / 1e6);
+        format_latencies(&latencies[0], std::size(latencies), frame_times);
+        finish();
+        reference = write_end;
+        return true;
+    }
+
+    // Moves the start of the run to `now`, to exclude the setup preceding the first frame.
+    void restart(clock::time_point now) noexcept {
+        warmup_end += now - start;
+        start = reference = end = now;
+    }
+
+    // Folds the current window into the totals.
+    void finish() noexcept {
+        total_frame_times.merge(frame_times);
+        frame_times.reset();
+        total_written += written;
+        total_cells += cells;
+        written = 0;
+        frames = 0;
+        cells = 0;
+    }
+
+    int format(char* buffer, size_t size) const noexcept {
+        return snprintf(buffer, size, "%.1f fps | %.3f MB/s | %.2f Mcells/s | %s", fps, mbps, mcps, &latencies[0]);
+    }
+};
+
+struct Frame {
+    std::string data;
+    size_t cells = 0;
+};
+
+// A lock-free single-producer single-consumer ring of frame buffers. The producer composes
+// into the slot at `head`, the consumer writes out the one at `tail`. Instead of spinning,
+// either side blocks via atomic wait/notify while the ring is full or empty respectively,
+// as the CPU time is better spent on the terminal, which usually runs on the same machine.
+struct FrameRing {
+    static constexpr size_t capacity = 3;
+
+    std::array<Frame, capacity> slots;
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+
+    // Returns the slot to compose the next frame into, once one is free.
+    Frame& acquire() noexcept {
+        const auto h = head.load(std::memory_order_relaxed);
+        for (;;) {
+            const auto t = tail.load(std::memory_order_acquire);
+            if (h - t < capacity) {
+                break;
+            }
+            tail.wait(t, std::memory_order_acquire);
+        }
+        return slots[h % capacity];
+    }
+
+    void publish() noexcept {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        head.notify_one();
+    }
+
+    // Publishes an empty frame, which tells the consumer to stop.
+    void close() noexcept {
+        acquire().data.clear();
+        publish();
+    }
+
+    // Returns the next frame to write. It's empty if the ring was closed.
+    const Frame& peek() noexcept {
+        const auto t = tail.load(std::memory_order_relaxed);
+        head.wait(t, std::memory_order_acquire);
+        return slots[t % capacity];
+    }
+
+    void pop() noexcept {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        tail.notify_one();
+    }
+};
+
+// Measures how far the terminal lags behind the byte stream, by timing the round trip of
+// a DSR or DA1 query sent after a frame until its reply arrives on stdin. There's at most
+// one query in flight. The replies are parsed by the thread reading stdin.
+struct Probe {
+    using clock = std::chrono::steady_clock;
+
+    // When the query in flight was sent, in clock ticks, or 0 if there's none.
+    std::atomic<clock::rep> sent{0};
+
+    std::mutex mutex;
+    // latencies covers the current stats window, total_latencies the run up until then.
+    Histogram latencies;
+    Histogram total_latencies;
+    size_t timeouts = 0;
+
+    // Input parser state.
+    char sequence[32]{};
+    size_t sequence_length = 0;
+
+    void reset() noexcept {
+        const std::lock_guard lock{mutex};
+        latencies.reset();
+        total_latencies.reset();
+        timeouts = 0;
+        sent.store(0, std::memory_order_relaxed);
+    }
+
+    // Feeds input from stdin into the parser. Anything but CSI sequences is ignored.
+    void parse(const char* data, size_t size) noexcept {
+        for (size_t i = 0; i < size; ++i) {
+            const auto ch = data[i];
+            if (ch == '\x1b') {
+                sequence_length = 0;
+            } else if (sequence_length == 0) {
+                continue;
+            }
+
+            if (sequence_length < std::size(sequence)) {
+                sequence[sequence_length++] = ch;
+            }
+
+            // The final byte of a CSI sequence ends it. The reply to DSR is "\x1b[<row>;<col>R"
+            // and the reply to DA1 is "\x1b[?<attributes>c". Anything else, like keys, is ignored.
+            if (sequence_length >= 3 && sequence[1] == '[' && ch >= 0x40 && ch <= 0x7e) {
+                if (ch == 'R' || (ch == 'c' && sequence[2] == '?')) {
+                    received(clock::now());
+                }
+                sequence_length = 0;
+            }
+        }
+    }
+
+    void received(clock::time_point now) noexcept {
+        const auto s = sent.exchange(0, std::memory_order_relaxed);
+        if (!s) {
+            return;
+        }
+        const auto latency = now - clock::time_point{clock::duration{s}};
+        const std::lock_guard lock{mutex};
+        latencies.record(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+    }
+};
+
+static Probe probe;
+
+// HSV offers at most 1530 distinct colors in 8-bit RGB
+static constexpr size_t max_rainbow_colors = 1530;
+
+// The values of the options varied by --sweep. The benchmark runs once for every combination of them.
+// Axes that are empty aren't swept.
+struct Sweep {
+    std::vector<size_t> colors;
+    std::vector<ColorMode> color_modes;
+    std::vector<GlyphSet> glyph_sets;
+    std::vector<std::pair<size_t, size_t>> sizes;
+    std::vector<size_t> unique_glyphs;
+    // The --sync modes and how many frames share a synchronized update.
+    std::vector<std::pair<SyncMode, size_t>> syncs;
+    // Percentages for --attrs. Sweeps all attributes unless --attrs names some.
+    std::vector<size_t> attribute_densities;
+
+    bool empty() const noexcept {
+        return colors.empty() && color_modes.empty() && glyph_sets.empty() && sizes.empty() && unique_glyphs.empty() && syncs.empty() && attribute_densities.empty();
+    }
+};
+
+// Everything that's configurable via the command line.
+struct Options {
+    size_t num_colors = max_rainbow_colors;
+    ColorMode color_mode = ColorMode_All;
+    Palette palette = Palette_TrueColor;
+    char char_override[4]{};
+    size_t char_override_length = 0;
+    GlyphSet glyph_set = GlyphSet_Ascii;
+    // Limits the glyph set to this many distinct glyphs, spread over the entire screen. 0 means unlimited.
+    size_t unique_glyphs = 0;
+    size_t size_override_cols = 0;
+    size_t size_override_rows = 0;
+    bool use_writev = false;
+    bool use_pipeline = false;
+    DamageMode damage_mode = DamageMode_Full;
+    size_t damage_count = 1;
+    SgrMode sgr_mode = SgrMode_Full;
+    // --attrs mixes a random subset of these attributes into attribute_density percent of the cells.
+    uint8_t attributes = 0;
+    size_t attribute_density = 25;
+    // How frames are delimited and how many of them share one synchronized update.
+    SyncMode sync_mode = SyncMode_2026;
+    size_t sync_batch = 1;
+    // How many adjacent cells share a color.
+    size_t run_length = 1;
+    size_t stream_count = 1;
+    std::vector<std::string> stream_ttys;
+    // In seconds. 0 means unlimited.
+    double duration = 0;
+    // --fps paces the frames to this rate. 0 means as fast as possible.
+    double target_fps = 0;
+    // --resize-storm resizes the terminal this often, in seconds. 0 disables it.
+    double resize_interval = 0;
+    double warmup = 0;
+    size_t frame_limit = 0;
+    // The largest write syscall in bytes, or 0 for no limit.
+    size_t chunk = 0;
+    bool chunk_auto = false;
+    // The memory budget for --precompute in bytes, shared by all streams. 0 disables it.
+    size_t precompute_budget = 0;
+    const char* report_path = nullptr;
+    bool report_csv = false;
+    // In seconds. 0 disables the probe.
+    double probe_interval = 0;
+    bool probe_da1 = false;
+    // The process whose RSS is sampled with --damage=scrollback and whose usage --monitor samples. 0 if unknown.
+    long terminal_pid = 0;
+    bool monitor = false;
+    // --host runs a copy of ourselves inside a pseudoconsole instead of drawing.
+    bool host = false;
+    // --replay writes this capture instead of the rainbow, in frames of replay_frame bytes,
+    // or of as many lines as the screen has rows if it's 0.
+    const char* replay_path = nullptr;
+    size_t replay_frame = 0;
+    // --record writes the frames into this file instead of the console.
+    const char* record_path = nullptr;
+    // --runs repeats every step this often, pausing for cooldown seconds in between.
+    size_t runs = 1;
+    double cooldown = 2;
+    // --compare tests the runs against this JSON report of earlier ones.
+    const char* compare_path = nullptr;
+    // --series streams the stats of every window into this file or to this udp://host:port.
+    const char* series_path = nullptr;
+
+    Sweep sweep;
+
+    // Derived from num_colors and palette by build_colors().
+    std::array<Color, max_rainbow_colors> colors{};
+};
+
+// Returns the entry of the xterm-256 palette closest to the given color,
+// out of the 6x6x6 color cube (16-231) and the gray ramp (232-255).
+static Color quantize_256(const RGB& c) noexcept {
+    static constexpr uint8_t levels[6]{0, 95, 135, 175, 215, 255};
+    const auto level = [](uint8_t v) -> uint8_t {
+        return v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40;
+    };
+    const auto distance = [&](const RGB& a) {
+        const auto dr = int(a.r) - c.r;
+        const auto dg = int(a.g) - c.g;
+        const auto db = int(a.b) - c.b;
+        return dr * dr + dg * dg + db * db;
+    };
+
+    const auto r = level(c.r);
+    const auto g = level(c.g);
+    const auto b = level(c.b);
+    const RGB cube{levels[r], levels[g], levels[b]};
+
+    const auto average = (c.r + c.g + c.b) / 3;
+    const auto gray_step = std::min(average > 8 ? (average - 8) / 10 : 0, 23);
+    const auto gray_level = static_cast<uint8_t>(8 + gray_step * 10);
+    const RGB gray{gray_level, gray_level, gray_level};
+
+    if (distance(gray) < distance(cube)) {
+        return {gray, static_cast<uint8_t>(232 + gray_step)};
+    }
+    return {cube, static_cast<uint8_t>(16 + 36 * r + 6 * g + b)};
+}
+
+// Returns the entry of the 16 color palette closest to the given color, assuming xterm's defaults.
+static Color quantize_16(const RGB& c) noexcept {
+    static constexpr RGB palette[16]{
+        {0, 0, 0},
+        {205, 0, 0},
+        {0, 205, 0},
+        {205, 205, 0},
+        {0, 0, 238},
+        {205, 0, 205},
+        {0, 205, 205},
+        {229, 229, 229},
+        {127, 127, 127},
+        {255, 0, 0},
+        {0, 255, 0},
+        {255, 255, 0},
+        {92, 92, 255},
+        {255, 0, 255},
+        {0, 255, 255},
+        {255, 255, 255},
+    };
+
+    uint8_t best = 0;
+    int best_distance = INT_MAX;
+    for (uint8_t i = 0; i < 16; ++i) {
+        const auto dr = int(palette[i].r) - c.r;
+        const auto dg = int(palette[i].g) - c.g;
+        const auto db = int(palette[i].b) - c.b;
+        const auto distance = dr * dr + dg * dg + db * db;
+        if (distance < best_distance) {
+            best = i;
+            best_distance = distance;
+        }
+    }
+    return {palette[best], best};
+}
+
+static void build_colors(Options& options) noexcept {
+    const auto num_colors = options.num_colors;
+
+    for (size_t i = 0; i < num_colors; ++i) {
+        // https://en.wikipedia.org/wiki/HSL_and_HSV#HSV_to_RGB
+        const auto h = double(i) / double(num_colors) * 360.0;
+        const auto hh = static_cast<int>(h / 60.0);
+        const auto v = static_cast<int>(256.0 / 60.0 * std::fmod(h, 60.0));
+        uint8_t r, g, b;
+
+        switch (hh % 6) {
+        case 0:
+            r = 255;
+            g = v;
+            b = 0;
+            break;
+        case 1:
+            r = 255 - v;
+            g = 255;
+            b = 0;
+            break;
+        case 2:
+            r = 0;
+            g = 255;
+            b = v;
+            break;
+        case 3:
+            r = 0;
+            g = 255 - v;
+            b = 255;
+            break;
+        case 4:
+            r = v;
+            g = 0;
+            b = 255;
+            break;
+        case 5:
+            r = 255;
+            g = 0;
+            b = 255 - v;
+            break;
+        default:
+            std::terminate();
+        }
+
+        const RGB rgb{r, g, b};
+        switch (options.palette) {
+        case Palette_256:
+            options.colors[i] = quantize_256(rgb);
+            break;
+        case Palette_16:
+            options.colors[i] = quantize_16(rgb);
+            break;
+        default:
+            options.colors[i] = {rgb, 0};
+            break;
+        }
+    }
+}
+
+// splitmix64
+static uint64_t next_random(uint64_t& state) noexcept {
+    auto z = (state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+// The UTF-8 of a cell and the number of columns it occupies.
+struct Glyph {
+    char data[32];
+    uint8_t length;
+    uint8_t width;
+};
+
+// The CJK glyphs are taken from these blocks of CJK Unified Ideographs, in order.
+static constexpr std::pair<uint32_t, uint32_t> cjk_blocks[]{
+    {0x4e00, 0x9fff},   // CJK Unified Ideographs
+    {0x3400, 0x4dbf},   // Extension A
+    {0x20000, 0x2a6df}, // Extension B
+};
+
+// Returns how many distinct glyphs the set contains.
+static size_t glyph_set_size(GlyphSet set) noexcept {
+    switch (set) {
+    case GlyphSet_Cjk: {
+        size_t size = 0;
+        for (const auto& [beg, end] : cjk_blocks) {
+            size += end - beg + 1;
+        }
+        return size;
+    }
+    case GlyphSet_Combining:
+        return 26 * 112 * 113;
+    case GlyphSet_Emoji:
+        return 216;
+    case GlyphSet_Mixed:
+        // Only an upper bound, since the smaller sets repeat sooner.
+        return glyph_set_size(GlyphSet_Combining);
+    default:
+        return 94;
+    }
+}
+
+// Returns the -ch= glyph, which replaces the glyph set, or an empty one.
+static Glyph make_override_glyph(const Options& options) noexcept {
+    Glyph glyph{};
+    memcpy(&glyph.data[0], &options.char_override[0], options.char_override_length);
+    glyph.length = static_cast<uint8_t>(options.char_override_length);
+    glyph.width = 1;
+    return glyph;
+}
+
+// Returns the i-th glyph of the glyph set.
+// Except for GlyphSet_Mixed the first glyph_set_size() glyphs are all distinct.
+template<GlyphSet Set>
+static Glyph make_glyph(size_t i) noexcept {
+    // Adding a skin tone to these yields 6 * 3 * 12 = 216 distinct sequences.
+    static constexpr uint32_t emoji_people[3]{0x1f468, 0x1f469, 0x1f9d1};
+    static constexpr uint32_t emoji_objects[12]{0x1f4bb, 0x1f52c, 0x1f680, 0x1f373, 0x1f3a8, 0x1f692, 0x1f33e, 0x1f393, 0x1f3eb, 0x1f527, 0x1f4bc, 0x1f3ed};
+
+    Glyph glyph{};
+    auto p = &glyph.data[0];
+    glyph.width = 1;
+
+    if constexpr (Set == GlyphSet_Mixed) {
+        uint64_t state = i;
+        switch (next_random(state) % GlyphSet_Mixed) {
+        case GlyphSet_Cjk:
+            return make_glyph<GlyphSet_Cjk>(i);
+        case GlyphSet_Combining:
+            return make_glyph<GlyphSet_Combining>(i);
+        case GlyphSet_Emoji:
+            return make_glyph<GlyphSet_Emoji>(i);
+        default:
+            return make_glyph<GlyphSet_Ascii>(i);
+        }
+    } else if constexpr (Set == GlyphSet_Cjk) {
+        auto index = i % glyph_set_size(GlyphSet_Cjk);
+        for (const auto& [beg, end] : cjk_blocks) {
+            if (index <= end - beg) {
+                p = encode_utf8(p, static_cast<uint32_t>(beg + index));
+                break;
+            }
+            index -= end - beg + 1;
+        }
+        glyph.width = 2;
+    } else if constexpr (Set == GlyphSet_Combining) {
+        // A letter, one of the 112 marks in U+0300-U+036F and optionally a second one.
+        const auto index = i % glyph_set_size(GlyphSet_Combining);
+        const auto second = index / (26 * 112);
+        *p++ = static_cast<char>('a' + index % 26);
+        p = encode_utf8(p, static_cast<uint32_t>(0x300 + index / 26 % 112));
+        if (second) {
+            p = encode_utf8(p, static_cast<uint32_t>(0x300 + second - 1));
+        }
+    } else if constexpr (Set == GlyphSet_Emoji) {
+        i %= 216;
+        const auto tone = i / 36;
+        p = encode_utf8(p, emoji_people[i % 3]);
+        if (tone) {
+            p = encode_utf8(p, static_cast<uint32_t>(0x1f3fa + tone));
+        }
+        p = encode_utf8(p, 0x200d);
+        p = encode_utf8(p, emoji_objects[i / 3 % 12]);
+        glyph.width = 2;
+    } else {
+        *p++ = static_cast<char>('!' + i % 94);
+    }
+
+    glyph.length = static_cast<uint8_t>(p - &glyph.data[0]);
+    return glyph;
+}
+
+// The pre-encoded cells all frames are sliced from. Cell i is colored with colors[i / run_length % num_colors]
+// and since the rows start at any of the `period` cells, period + cols cells are needed.
+//
+// With SgrMode_Minimal each cell only carries the colors that changed since the previous one.
+// As a slice can't rely on whatever preceded it, `heads` then holds the complete SGR sequence
+// of each cell, which is submitted first, followed by the remainder of the slice starting at the
+// glyph of its first cell. The cells' SGR sequences can be found between indices and glyphs.
+//
+// Glyph sets with wide glyphs additionally have `columns`, the prefix sum of the cells' widths,
+// which slices are measured in. A wide glyph that doesn't fit anymore is replaced with a space.
+//
+// Row y of frame i starts at cell i + y * row_step. Normally that's a diagonal rainbow, but only
+// about cols + 2 * rows distinct cells are on screen then. --unique-glyphs lays out the rows back to
+// back instead and cell i gets glyph i % unique_glyphs, with the period rounded up to fit them all.
+//
+// --attrs wraps the glyphs of some cells in attributes, which the cell resets right after its glyph.
+// They're part of the glyph, between glyphs and indices of the next cell, so they survive SgrMode_Minimal.
+struct Rainbow {
+    std::string data;
+    std::vector<size_t> indices;
+    std::vector<size_t> glyphs;
+    std::vector<size_t> columns;
+    std::string heads;
+    std::vector<size_t> head_indices;
+    size_t period = 0;
+    size_t row_step = 2;
+    // The rainbow only depends on the column count. Resizes that keep it don't need a rebuild.
+    size_t cols = 0;
+
+    // Returns false if the rainbow is still up to date.
+    bool rebuild(const Options& options, size_t new_cols) {
+        if (!indices.empty() && cols == new_cols) {
+            return false;
+        }
+        cols = new_cols;
+
+        // One instantiation of build() per color mode and glyph set, so that the loops over
+        // the cells don't branch on either. The right one is picked once per rebuild.
+        static constexpr auto builds = []<size_t... I>(std::index_sequence<I...>) {
+            return std::array{&Rainbow::build<static_cast<ColorMode>(I / glyph_set_count), static_cast<GlyphSet>(I % glyph_set_count)>...};
+        }(std::make_index_sequence<color_mode_count * glyph_set_count>{});
+        (this->*builds[options.color_mode * glyph_set_count + options.glyph_set])(options);
+        return true;
+    }
+
+    template<ColorMode Mode, GlyphSet Set>
+    void build(const Options& options) {
+        const auto num_colors = options.num_colors;
+        const auto run_length = options.run_length;
+        const auto& colors = options.colors;
+        const auto fg_offset = std::max<size_t>(1, (num_colors + 5) / 10);
+        const auto minimal = options.sgr_mode == SgrMode_Minimal;
+        period = num_colors * run_length;
+        row_step = 2;
+        if (options.unique_glyphs) {
+            period *= (options.unique_glyphs + period - 1) / period;
+            row_step = cols;
+        }
+        const auto count = period + cols;
+        const auto override_glyph = make_override_glyph(options);
+        const auto glyph_of = [&](size_t i) {
+            if (override_glyph.length) {
+                return override_glyph;
+            }
+            return make_glyph<Set>(options.unique_glyphs ? i % period % options.unique_glyphs : i);
+        };
+        // The attributes of cell i, repeating with the period like the colors.
+        const auto attributes_of = [&](size_t i) -> uint8_t {
+            if (!options.attributes) {
+                return 0;
+            }
+            uint64_t state = ~static_cast<uint64_t>(i % period);
+            const auto r = next_random(state);
+            if (r % 100 >= options.attribute_density) {
+                return 0;
+            }
+            const auto subset = static_cast<uint8_t>(r >> 32) & options.attributes;
+            return subset ? subset : options.attributes;
+        };
+        const auto underline_of = [&](size_t i) -> const Color& {
+            return colors[(i / run_length + num_colors / 2) % num_colors];
+        };
+
+        // The colors of cell i, or null if the color mode doesn't set them.
+        const auto bg_of = [&](size_t i) -> const Color* {
+            if constexpr (Mode == ColorMode_All || Mode == ColorMode_Background) {
+                return &colors[i / run_length % num_colors];
+            } else {
+                return nullptr;
+            }
+        };
+        const auto fg_of = [&](size_t i) -> const Color* {
+            if constexpr (Mode == ColorMode_All) {
+                return &colors[(i / run_length + fg_offset) % num_colors];
+            } else if constexpr (Mode == ColorMode_Foreground) {
+                return &colors[i / run_length % num_colors];
+            } else {
+                return nullptr;
+            }
+        };
+        // Returns the color unless it's the same as the previous one.
+        const auto changed = [](const Color* c, const Color* previous) -> const Color* {
+            if (c && previous && c->index == previous->index && c->rgb.r == previous->rgb.r && c->rgb.g == previous->rgb.g && c->rgb.b == previous->rgb.b) {
+                return nullptr;
+            }
+            return c;
+        };
+        // The SGR colors that cell i carries in `data`.
+        const auto cell_sgr = [&](size_t i) -> std::pair<const Color*, const Color*> {
+            if (!minimal || i == 0) {
+                return {bg_of(i), fg_of(i)};
+            }
+            return {changed(bg_of(i), bg_of(i - 1)), changed(fg_of(i), fg_of(i - 1))};
+        };
+
+        // Compute the exact size up front, so that there's only a single allocation,
+        // which is reused if the next resize results in the same or a smaller size.
+        size_t size = 0;
+        size_t heads_size = 0;
+        bool wide = false;
+        for (size_t i = 0; i < count; ++i) {
+            const auto glyph = glyph_of(i);
+            size += glyph.length;
+            wide |= glyph.width != 1;
+            if (const auto attributes = attributes_of(i)) {
+                size += attributes_length(options.palette, attributes, underline_of(i), i % period);
+            }
+            const auto [bg, fg] = cell_sgr(i);
+            size += sgr_length(options.palette, bg, fg);
+            if (minimal && i < period) {
+                heads_size += sgr_length(options.palette, bg_of(i), fg_of(i));
+            }
+        }
+
+        // encode_u8() may store up to 3 bytes past the end of the number.
+        data.resize(size + 3);
+        indices.resize(count + 1);
+        glyphs.resize(count);
+        columns.clear();
+        if (wide) {
+            columns.resize(count + 1);
+            // Rows of wide glyphs contain fewer cells.
+            if (options.unique_glyphs) {
+                row_step = std::max<size_t>(1, cols / 2);
+            }
+        }
+
+        const auto base = data.data();
+        auto p = base;
+
+        for (size_t i = 0; i < count; ++i) {
+            indices[i] = p - base;
+
+            const auto [bg, fg] = cell_sgr(i);
+            p = encode_sgr(p, options.palette, bg, fg);
+            glyphs[i] = p - base;
+
+            // Using ▀ would be graphically more pleasing, but in this benchmark
+            // we want to test rendering performance and DirectWrite, as used
+            // in Windows Terminal, has a very poor font-fallback performance.
+            // If we were to use ▀, we'd primarily test how fast DirectWrite is.
+            const auto glyph = glyph_of(i);
+            const auto attributes = attributes_of(i);
+            p = encode_attributes_on(p, options.palette, attributes, underline_of(i), i % period);
+            memcpy(p, &glyph.data[0], glyph.length);
+            p += glyph.length;
+            p = encode_attributes_off(p, attributes);
+
+            if (wide) {
+                columns[i + 1] = columns[i] + glyph.width;
+            }
+        }
+
+        indices[count] = p - base;
+        data.resize(size);
+
+        heads.clear();
+        head_indices.clear();
+        if (minimal) {
+            heads.resize(heads_size + 3);
+            head_indices.resize(period + 1);
+
+            const auto heads_base = heads.data();
+            auto h = heads_base;
+            for (size_t i = 0; i < period; ++i) {
+                head_indices[i] = h - heads_base;
+                h = encode_sgr(h, options.palette, bg_of(i), fg_of(i));
+            }
+            head_indices[period] = h - heads_base;
+            heads.resize(heads_size);
+        }
+    }
+
+    // Returns the cell covering column x of a row that starts at cell idx, and the column that cell starts at.
+    std::pair<size_t, size_t> cell_at(size_t idx, size_t x) const noexcept {
+        if (columns.empty()) {
+            return {idx + x, x};
+        }
+        const auto limit = columns[idx] + x;
+        const auto cell = std::upper_bound(columns.begin() + idx, columns.begin() + idx + x + 1, limit) - columns.begin() - 1;
+        return {static_cast<size_t>(cell), columns[cell] - columns[idx]};
+    }
+
+    // Calls append() with the pieces that make up `count` columns worth of encoded cells starting at cell idx.
+    template<typename Append>
+    void slice(size_t idx, size_t count, Append&& append) const {
+        static constexpr char padding = ' ';
+
+        auto end_idx = idx + count;
+        auto pad = false;
+        if (!columns.empty()) {
+            const auto limit = columns[idx] + count;
+            end_idx = std::upper_bound(columns.begin() + idx, columns.begin() + idx + count + 1, limit) - columns.begin() - 1;
+            pad = columns[end_idx] != limit;
+        }
+
+        auto beg = indices[idx];
+        if (!head_indices.empty()) {
+            // Heads only exist for one period, as cell idx carries the same colors as idx - period.
+            const auto h = idx % period;
+            const auto head_beg = head_indices[h];
+            const auto head_end = head_indices[h + 1];
+            if (head_end != head_beg) {
+                append(heads.data() + head_beg, head_end - head_beg);
+            }
+            beg = glyphs[idx];
+        }
+        // If not even the first glyph fits, only its colors are needed for the padding.
+        const auto end = end_idx > idx ? indices[end_idx] : glyphs[idx];
+        if (end > beg) {
+            append(data.data() + beg, end - beg);
+        }
+        if (pad) {
+            append(&padding, 1);
+        }
+    }
+};
+
+// Memory for the --precompute frames. They're streamed through once per write and
+// may span gigabytes, so huge pages are used if possible to take the TLB out of the picture.
+struct Arena {
+    char* data = nullptr;
+    size_t capacity = 0;
+    // What backs the memory.
+    const char* backing = "none";
+
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena() {
+        release();
+    }
+
+    // Ensures room for at least `size` bytes, discarding the previous contents.
+    bool reserve(size_t size) noexcept {
+        if (size <= capacity) {
+            return true;
+        }
+        release();
+
+#ifdef _WIN32
+        // Large pages require SeLockMemoryPrivilege, which is rarely granted.
+        if (const auto large = GetLargePageMinimum()) {
+            const auto rounded = (size + large - 1) / large * large;
+            data = static_cast<char*>(VirtualAlloc(nullptr, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE));
+            if (data) {
+                capacity = rounded;
+                backing = "large pages";
+                return true;
+            }
+        }
+        data = static_cast<char*>(VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+        if (!data) {
+            return false;
+        }
+        capacity = size;
+        backing = "pages";
+#else
+        static constexpr size_t huge_page_size = 2 * 1024 * 1024;
+        const auto rounded = (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+        void* p = MAP_FAILED;
+        backing = "pages";
+#ifdef MAP_HUGETLB
+        // This only succeeds if the administrator reserved huge pages (vm.nr_hugepages).
+        p = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            backing = "hugetlb";
+        }
+#endif
+        if (p == MAP_FAILED) {
+            p = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED) {
+                return false;
+            }
+#ifdef MADV_HUGEPAGE
+            // Transparent huge pages are the next best thing.
+            if (madvise(p, rounded, MADV_HUGEPAGE) == 0) {
+                backing = "thp";
+            }
+#endif
+        }
+        data = static_cast<char*>(p);
+        capacity = rounded;
+#endif
+        return true;
+    }
+
+    void release() noexcept {
+        if (!data) {
+            return;
+        }
+#ifdef _WIN32
+        VirtualFree(data, 0, MEM_RELEASE);
+#else
+        munmap(data, capacity);
+#endif
+        data = nullptr;
+        capacity = 0;
+        backing = "none";
+    }
+};
+
+// A read-only mapping of an entire file, used by --replay.
+struct MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+    bool open(const char* path) noexcept {
+#ifdef _WIN32
+        file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        LARGE_INTEGER file_size{};
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &file_size) || !file_size.QuadPart) {
+            return false;
+        }
+        mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) {
+            return false;
+        }
+        data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        size = static_cast<size_t>(file_size.QuadPart);
+        return data != nullptr;
+#else
+        const auto fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return false;
+        }
+        const auto end = lseek(fd, 0, SEEK_END);
+        if (end <= 0) {
+            ::close(fd);
+            return false;
+        }
+        const auto p = mmap(nullptr, size_t(end), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+        // The capture is written from front to back, usually more than once.
+        // Reading it in up front keeps disk I/O out of the first pass.
+        madvise(p, size_t(end), MADV_SEQUENTIAL);
+        madvise(p, size_t(end), MADV_WILLNEED);
+        data = static_cast<const char*>(p);
+        size = size_t(end);
+        return true;
+#endif
+    }
+
+    void close() noexcept {
+#ifdef _WIN32
+        if (data) {
+            UnmapViewOfFile(data);
+        }
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        file = INVALID_HANDLE_VALUE;
+        mapping = nullptr;
+#else
+        if (data) {
+            munmap(const_cast<char*>(data), size);
+        }
+#endif
+        data = nullptr;
+        size = 0;
+    }
+};
+
+// The capture given by --replay, shared by all streams.
+static MappedFile replay_file;
+
+// The chunk sizes --chunk=auto picks from, 0 being unlimited.
+static constexpr size_t chunk_candidates[]{4 << 10, 16 << 10, 64 << 10, 256 << 10, 1 << 20, 0};
+
+// Returns the resident memory of the process in bytes, or 0 if it can't be queried.
+static size_t query_rss(long pid) noexcept {
+    if (pid <= 0) {
+        return 0;
+    }
+#ifdef _WIN32
+    size_t rss = 0;
+    if (const auto process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, static_cast<DWORD>(pid))) {
+        PROCESS_MEMORY_COUNTERS counters{};
+        if (K32GetProcessMemoryInfo(process, &counters, sizeof(counters))) {
+            rss = counters.WorkingSetSize;
+        }
+        CloseHandle(process);
+    }
+    return rss;
+#elif defined(__APPLE__)
+    proc_taskinfo info{};
+    if (proc_pidinfo(static_cast<int>(pid), PROC_PIDTASKINFO, 0, &info, sizeof(info)) != sizeof(info)) {
+        return 0;
+    }
+    return info.pti_resident_size;
+#else
+    char path[64];
+    snprintf(&path[0], std::size(path), "/proc/%ld/statm", pid);
+    const auto file = fopen(&path[0], "r");
+    if (!file) {
+        return 0;
+    }
+    unsigned long long size = 0, resident = 0;
+    const auto ok = fscanf(file, "%llu %llu", &size, &resident) == 2;
+    fclose(file);
+    return ok ? resident * static_cast<size_t>(sysconf(_SC_PAGESIZE)) : 0;
+#endif
+}
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+// Reads /proc/<pid>/stat into the buffer and returns the fields after the command name, starting with
+// the state, or nullptr on failure. The name in parentheses may contain anything, including spaces.
+static const char* read_proc_stat(long pid, char (&buffer)[512]) noexcept {
+    char path[64];
+    snprintf(&path[0], std::size(path), "/proc/%ld/stat", pid);
+    const auto file = fopen(&path[0], "r");
+    if (!file) {
+        return nullptr;
+    }
+    const auto length = fread(&buffer[0], 1, std::size(buffer) - 1, file);
+    fclose(file);
+    buffer[length] = '\0';
+    const auto name_end = strrchr(&buffer[0], ')');
+    return name_end ? name_end + 1 : nullptr;
+}
+
+// Reads the parent and the controlling terminal of the process.
+static bool read_proc_parent(long pid, long& ppid, long& tty) noexcept {
+    char buffer[512];
+    const auto fields = read_proc_stat(pid, buffer);
+    return fields && sscanf(fields, " %*c %ld %*d %*d %ld", &ppid, &tty) == 2;
+}
+#endif
+
+// Guesses which process is the terminal we're running in, for --monitor and --damage=scrollback's RSS samples.
+// On Linux that's the closest ancestor that isn't attached to our own terminal, like the emulator
+// (or a multiplexer's server) that hosts it. On Windows it's the owner of the console window, which
+// is conhost for classic consoles, but only a stand-in for terminals that host the console via ConPTY.
+static long find_terminal_pid() noexcept {
+#ifdef _WIN32
+    DWORD pid = 0;
+    if (const auto window = GetConsoleWindow()) {
+        GetWindowThreadProcessId(window, &pid);
+    }
+    return static_cast<long>(pid);
+#elif defined(__APPLE__)
+    return 0;
+#else
+    long ppid, tty;
+    if (!read_proc_parent(getpid(), ppid, tty) || !tty) {
+        return 0;
+    }
+    const auto own_tty = tty;
+    for (auto pid = ppid; pid > 1; pid = ppid) {
+        if (!read_proc_parent(pid, ppid, tty)) {
+            return 0;
+        }
+        if (tty != own_tty) {
+            return pid;
+        }
+    }
+    return 0;
+#endif
+}
+
+// Samples the CPU, memory and GPU usage of another process for --monitor, which is usually the terminal.
+// The GPU usage comes from the DRM fdinfo of its GPU clients on Linux and from the "GPU Engine"
+// performance counters on Windows. Either sums the busy time over all engines, so it can exceed 100%.
+struct ProcessMonitor {
+    using clock = std::chrono::steady_clock;
+
+    struct Usage {
+        // Since the previous sample. gpu_percent is negative if it's unknown.
+        double cpu_percent = 0;
+        double gpu_percent = -1;
+        size_t rss = 0;
+    };
+
+    long pid = 0;
+    clock::time_point last_time;
+    double last_cpu = 0;
+    double last_gpu = -1;
+#ifdef _WIN32
+    HANDLE process = nullptr;
+    PDH_HQUERY query = nullptr;
+    PDH_HCOUNTER counter = nullptr;
+#endif
+
+    bool open(long target) noexcept {
+        pid = target;
+#ifdef _WIN32
+        process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, static_cast<DWORD>(pid));
+        if (!process) {
+            return false;
+        }
+        if (PdhOpenQueryW(nullptr, 0, &query) != ERROR_SUCCESS) {
+            query = nullptr;
+        } else if (PdhAddEnglishCounterW(query, L"\\GPU Engine(*)\\Utilization Percentage", 0, &counter) != ERROR_SUCCESS) {
+            PdhCloseQuery(query);
+            query = nullptr;
+        } else {
+            // The counter is a rate, which needs a first collection to compute the next one against.
+            PdhCollectQueryData(query);
+        }
+#endif
+        last_time = clock::now();
+        last_cpu = cpu_seconds();
+        last_gpu = gpu_seconds();
+        return last_cpu >= 0;
+    }
+
+    void close() noexcept {
+#ifdef _WIN32
+        if (query) {
+            PdhCloseQuery(query);
+            query = nullptr;
+        }
+        if (process) {
+            CloseHandle(process);
+            process = nullptr;
+        }
+#endif
+        pid = 0;
+    }
+
+    // The CPU time the process has spent so far, or -1 if it can't be queried.
+    double cpu_seconds() const noexcept {
+#ifdef _WIN32
+        FILETIME creation, exit, kernel, user;
+        if (!GetProcessTimes(process, &creation, &exit, &kernel, &user)) {
+            return -1;
+        }
+        const auto ticks = [](const FILETIME& t) {
+            return (uint64_t(t.dwHighDateTime) << 32) | t.dwLowDateTime;
+        };
+        return double(ticks(user) + ticks(kernel)) / 1e7;
+#elif defined(__APPLE__)
+        proc_taskinfo info{};
+        if (proc_pidinfo(static_cast<int>(pid), PROC_PIDTASKINFO, 0, &info, sizeof(info)) != sizeof(info)) {
+            return -1;
+        }
+        // The times are in Mach absolute time units, which aren't nanoseconds on Apple Silicon.
+        mach_timebase_info_data_t timebase{};
+        mach_timebase_info(&timebase);
+        return double(info.pti_total_user + info.pti_total_system) * timebase.numer / timebase.denom / 1e9;
+#else
+        char buffer[512];
+        const auto fields = read_proc_stat(pid, buffer);
+        unsigned long long utime, stime;
+        if (!fields || sscanf(fields, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2) {
+            return -1;
+        }
+        return double(utime + stime) / double(sysconf(_SC_CLK_TCK));
+#endif
+    }
+
+    // The busy time of the process' GPU engines so far, or -1 if it's unknown.
+    // Windows only offers the utilization as a rate, which is accounted for in sample().
+    double gpu_seconds() const noexcept {
+#if defined(_WIN32) || defined(__APPLE__)
+        return -1;
+#else
+        char path[64];
+        snprintf(&path[0], std::size(path), "/proc/%ld/fdinfo", pid);
+        const auto dir = opendir(&path[0]);
+        if (!dir) {
+            return -1;
+        }
+
+        // Each GPU client may be opened through several file descriptors, but must only be counted once.
+        std::vector<unsigned long long> clients;
+        double total = -1;
+        while (const auto entry = readdir(dir)) {
+            if (entry->d_name[0] == '.') {
+                continue;
+            }
+            char file_path[320];
+            snprintf(&file_path[0], std::size(file_path), "%s/%s", &path[0], entry->d_name);
+            const auto file = fopen(&file_path[0], "r");
+            if (!file) {
+                continue;
+            }
+            char line[256];
+            bool counted = false;
+            unsigned long long client = 0, ns = 0;
+            while (fgets(&line[0], std::size(line), file)) {
+                if (sscanf(&line[0], "drm-client-id: %llu", &client) == 1) {
+                    counted = std::find(clients.begin(), clients.end(), client) != clients.end();
+                    if (!counted) {
+                        clients.push_back(client);
+                    }
+                } else if (!counted && strncmp(&line[0], "drm-engine-", 11) == 0 && strncmp(&line[0], "drm-engine-capacity-", 20) != 0 && sscanf(&line[0], "drm-engine-%*[^:]: %llu ns", &ns) == 1) {
+                    total = std::max(total, 0.0) + ns / 1e9;
+                }
+            }
+            fclose(file);
+        }
+        closedir(dir);
+        return total;
+#endif
+    }
+
+    Usage sample() noexcept {
+        Usage usage;
+        const auto now = clock::now();
+        const auto wall = std::max(std::chrono::duration<double>(now - last_time).count(), 1e-9);
+        const auto cpu = cpu_seconds();
+        if (cpu >= 0) {
+            usage.cpu_percent = (cpu - last_cpu) / wall * 100;
+            last_cpu = cpu;
+        }
+        const auto gpu = gpu_seconds();
+        if (gpu >= 0 && last_gpu >= 0) {
+            usage.gpu_percent = (gpu - last_gpu) / wall * 100;
+        }
+        last_gpu = gpu;
+#ifdef _WIN32
+        if (query && PdhCollectQueryData(query) == ERROR_SUCCESS) {
+            // The instances are named like "pid_1234_luid_..._engtype_3D".
+            wchar_t prefix[32];
+            const auto prefix_length = static_cast<size_t>(swprintf(&prefix[0], std::size(prefix), L"pid_%ld_", pid));
+            DWORD size = 0, count = 0;
+            if (PdhGetFormattedCounterArrayW(counter, PDH_FMT_DOUBLE, &size, &count, nullptr) == PDH_MORE_DATA) {
+                std::vector<std::byte> buffer(size);
+                const auto items = reinterpret_cast<PDH_FMT_COUNTERVALUE_ITEM_W*>(buffer.data());
+                if (PdhGetFormattedCounterArrayW(counter, PDH_FMT_DOUBLE, &size, &count, items) == ERROR_SUCCESS) {
+                    usage.gpu_percent = 0;
+                    for (DWORD i = 0; i < count; ++i) {
+                        if (wcsncmp(items[i].szName, &prefix[0], prefix_length) == 0) {
+                            usage.gpu_percent += items[i].FmtValue.doubleValue;
+                        }
+                    }
+                }
+            }
+        }
+#endif
+        usage.rss = query_rss(pid);
+        last_time = now;
+        return usage;
+    }
+};
+
+// Taken at the end of each stats window with --monitor, next to the window's own results.
+struct MonitorSample {
+    // Seconds since the start of the run, including the warmup.
+    double elapsed = 0;
+    bool warm = false;
+    float mbps = 0;
+    float fps = 0;
+    ProcessMonitor::Usage usage;
+};
+
+// Taken at the end of each stats window with --damage=scrollback.
+struct ScrollbackSample {
+    // Seconds since the start of the run, including the warmup.
+    double elapsed = 0;
+    size_t lines = 0;
+    float mbps = 0;
+    // The RSS of the terminal in bytes, or 0 if unknown.
+    size_t terminal_rss = 0;
+};
+
+// The stats of one window of one stream, as written by --series.
+struct SeriesSample {
+    int64_t unix_ns = 0;
+    // Seconds since the series started, which spans all runs.
+    double elapsed = 0;
+    uint32_t stream = 0;
+    bool warm = false;
+    float fps = 0;
+    float mbps = 0;
+    float mcps = 0;
+    float p50_ms = 0;
+    float p99_ms = 0;
+    float max_ms = 0;
+    // The --monitor usage of the terminal, if sampled in this window. -1 and 0 otherwise.
+    float terminal_cpu_percent = -1;
+    size_t terminal_rss = 0;
+};
+
+// A bounded lock-free queue of SeriesSample (after Dmitry Vyukov's MPMC queue), which the streams
+// push into and the --series thread drains. Pushing never blocks: If the writer fell this far behind,
+// the sample is dropped and counted instead. At one sample per second per stream it never should.
+struct SeriesRing {
+    static constexpr size_t capacity = 1024;
+
+    struct Slot {
+        std::atomic<size_t> sequence{0};
+        SeriesSample sample;
+    };
+
+    std::array<Slot, capacity> slots;
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    std::atomic<size_t> dropped{0};
+
+    SeriesRing() noexcept {
+        for (size_t i = 0; i < capacity; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Safe to call from any number of threads.
+    void push(const SeriesSample& sample) noexcept {
+        auto pos = head.load(std::memory_order_relaxed);
+        for (;;) {
+            auto& slot = slots[pos % capacity];
+            const auto seq = slot.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.sample = sample;
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return;
+                }
+            } else if (diff < 0) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Must only be called by a single thread. Returns false if the ring is empty.
+    bool pop(SeriesSample& sample) noexcept {
+        const auto pos = tail.load(std::memory_order_relaxed);
+        auto& slot = slots[pos % capacity];
+        if (slot.sequence.load(std::memory_order_acquire) != pos + 1) {
+            return false;
+        }
+        sample = slot.sample;
+        slot.sequence.store(pos + capacity, std::memory_order_release);
+        tail.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+};
+
+static SeriesRing series_ring;
+
+// The --series thread, which drains series_ring every 250ms at a low priority and writes the samples
+// as CSV (for paths ending in .csv) or as InfluxDB line protocol (anything else, and always over UDP).
+struct SeriesWriter {
+#ifdef _WIN32
+    using socket_type = SOCKET;
+    static constexpr socket_type invalid_socket = INVALID_SOCKET;
+#else
+    using socket_type = int;
+    static constexpr socket_type invalid_socket = -1;
+#endif
+
+    FILE* file = nullptr;
+    socket_type socket = invalid_socket;
+#ifdef _WIN32
+    bool wsa_started = false;
+#endif
+    bool csv = false;
+    Stats::clock::time_point epoch;
+    size_t written = 0;
+    std::atomic<bool> stop{false};
+    std::thread thread;
+
+    bool open(const char* target) {
+        std::string_view t{target};
+        if (t.starts_with("udp://")) {
+            // udp://host:port, where an IPv6 host is enclosed in brackets.
+            t.remove_prefix(6);
+            const auto colon = t.rfind(':');
+            if (colon == std::string_view::npos) {
+                return false;
+            }
+            auto host = t.substr(0, colon);
+            if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+                host = host.substr(1, host.size() - 2);
+            }
+            const std::string host_str{host};
+            const std::string port_str{t.substr(colon + 1)};
+#ifdef _WIN32
+            WSADATA wsa;
+            if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+                return false;
+            }
+            wsa_started = true;
+#endif
+            addrinfo hints{};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_DGRAM;
+            addrinfo* info = nullptr;
+            if (getaddrinfo(host_str.c_str(), port_str.c_str(), &hints, &info) != 0) {
+                return false;
+            }
+            for (auto ai = info; ai && socket == invalid_socket; ai = ai->ai_next) {
+                socket = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+                if (socket != invalid_socket && connect(socket, ai->ai_addr, static_cast<int>(ai->ai_addrlen)) != 0) {
+                    close_socket();
+                }
+            }
+            freeaddrinfo(info);
+            return socket != invalid_socket;
+        }
+        csv = t.ends_with(".csv");
+        file = fopen(target, "w");
+        if (file && csv) {
+            fprintf(file, "unix_ms,elapsed_s,stream,warm,fps,mbps,mcells_per_s,p50_ms,p99_ms,max_ms,terminal_cpu_percent,terminal_rss_mb\n");
+        }
+        return file != nullptr;
+    }
+
+    void start() {
+        epoch = Stats::clock::now();
+        thread = std::thread([this] {
+            // Stay out of the way of the streams and of the terminal under test.
+#ifdef _WIN32
+            SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined(__APPLE__)
+            pthread_set_qos_class_self_np(QOS_CLASS_BACKGROUND, 0);
+#else
+            // On Linux this only applies to the calling thread.
+            setpriority(PRIO_PROCESS, 0, 19);
+#endif
+            while (!stop.load(std::memory_order_relaxed)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(250));
+                flush();
+            }
+            flush();
+        });
+    }
+
+    // Stops the thread after it wrote whatever is left in the ring.
+    void close() {
+        if (thread.joinable()) {
+            stop.store(true, std::memory_order_relaxed);
+            thread.join();
+        }
+        if (file) {
+            fclose(file);
+            file = nullptr;
+        }
+        close_socket();
+#ifdef _WIN32
+        if (wsa_started) {
+            WSACleanup();
+            wsa_started = false;
+        }
+#endif
+    }
+
+    void close_socket() noexcept {
+        if (socket != invalid_socket) {
+#ifdef _WIN32
+            closesocket(socket);
+#else
+            ::close(socket);
+#endif
+            socket = invalid_socket;
+        }
+    }
+
+    void flush() noexcept {
+        SeriesSample sample;
+        char line[512];
+        while (series_ring.pop(sample)) {
+            auto p = &line[0];
+            const auto end = p + std::size(line);
+            if (csv) {
+                format_append(
+                    p,
+                    end,
+                    "%" PRId64 ",%.3f,%u,%d,%.3f,%.6f,%.3f,%.4f,%.4f,%.4f,%.2f,%.3f\n",
+                    sample.unix_ns / 1000000,
+                    sample.elapsed,
+                    sample.stream,
+                    sample.warm,
+                    sample.fps,
+                    sample.mbps,
+                    sample.mcps,
+                    sample.p50_ms,
+                    sample.p99_ms,
+                    sample.max_ms,
+                    sample.terminal_cpu_percent,
+                    sample.terminal_rss / 1e6
+                );
+            } else {
+                format_append(
+                    p,
+                    end,
+                    "rainbowbench,stream=%u,warm=%s elapsed=%.3f,fps=%.3f,mbps=%.6f,mcells_per_s=%.3f,p50_ms=%.4f,p99_ms=%.4f,max_ms=%.4f",
+                    sample.stream,
+                    sample.warm ? "true" : "false",
+                    sample.elapsed,
+                    sample.fps,
+                    sample.mbps,
+                    sample.mcps,
+                    sample.p50_ms,
+                    sample.p99_ms,
+                    sample.max_ms
+                );
+                if (sample.terminal_cpu_percent >= 0) {
+                    format_append(p, end, ",terminal_cpu_percent=%.2f,terminal_rss_mb=%.3f", sample.terminal_cpu_percent, sample.terminal_rss / 1e6);
+                }
+                format_append(p, end, " %" PRId64 "\n", sample.unix_ns);
+            }
+            const auto length = static_cast<size_t>(p - &line[0]);
+            if (file) {
+                fwrite(&line[0], 1, length, file);
+            } else {
+                // One datagram per line. A lost one only leaves a gap in the series.
+                send(socket, &line[0], static_cast<int>(length), 0);
+            }
+            written++;
+        }
+        if (file) {
+            // Keeps `tail -f` up to date and limits what a crash of the terminal, or of us, would lose.
+            fflush(file);
+        }
+    }
+};
+
+static SeriesWriter series;
+
+// A producer of frames. By default there's just one, drawing onto the entire console.
+// With --streams each one draws into its own band of rows of the console, or into its own
+// terminal with --stream-ttys, and is driven by a thread of its own.
+struct Stream {
+    Sink* sink = &console_sink;
+    Sink tty;
+    size_t index = 0;
+    // The size of the sink.
+    size_t screen_cols = 0;
+    size_t screen_rows = 0;
+    // This stream draws into the rows [top, top + rows) of its sink.
+    size_t top = 0;
+    size_t cols = 0;
+    size_t rows = 0;
+    // The sequences preceding each frame, which depend on `top`.
+    char header[64]{};
+    size_t header_length = 0;
+    // The scrolling region of --damage=scroll, which is prepended to the next frame after a relayout.
+    // Writing it right away could overtake the frames that are still queued up with --pipeline.
+    char margins[32]{};
+    size_t margins_length = 0;
+
+    Rainbow rainbow;
+    // How long each Rainbow::rebuild() took, in nanoseconds.
+    Histogram rebuild_times;
+    Stats stats;
+    std::string output;
+    std::vector<iovec> segments;
+    // Holds the CUP sequences of partial updates. It's sized up front, because
+    // write_console_gather() may refer to it and so it must not reallocate mid-frame.
+    std::vector<char> scratch;
+    uint64_t random_state = 0;
+
+    // With --pipeline the stream's thread only composes frames and this one writes them,
+    // so that the write syscalls never have to wait for the composition of the next frame.
+    FrameRing ring;
+    std::thread writer;
+
+    // The stats are recorded by whichever thread performs the writes, but the status
+    // line is composed into the frames by the stream's thread. It's guarded by this mutex.
+    std::mutex status_mutex;
+    char status[384]{};
+    char status_copy[384]{};
+    size_t status_length = 0;
+    // Partial updates only redraw the status row when it changed.
+    bool status_dirty = true;
+
+    // Stream 0 shows the sum of these over its peers in its status line.
+    std::atomic<float> published_mbps{0};
+    std::span<Stream> peers;
+
+    // Set once --duration or --frames have been reached.
+    std::atomic<bool> done{false};
+
+    // Stream 0 keeps track of the process' CPU time and the time spent blocked in writes,
+    // since the warmup ended (for the report) and since the last stats window (for the status).
+    Accounting run_accounting;
+    Accounting window_accounting;
+    // --monitor's samples of the terminal, taken by stream 0, and its CPU time when the warmup ended.
+    ProcessMonitor monitor;
+    std::vector<MonitorSample> monitor_samples;
+    double monitor_run_cpu = 0;
+
+    // When the last --probe query was sent.
+    Stats::clock::time_point last_probe;
+
+    // The next --fps deadline and the stats about them. Only frames after the warmup count.
+    Stats::clock::time_point deadline;
+    std::atomic<size_t> missed_deadlines{0};
+    // How late frames started relative to their deadline.
+    Histogram lateness;
+
+    // Where the next --replay frame starts and how often the capture was written in full.
+    size_t replay_offset = 0;
+    size_t replay_loops = 0;
+
+    // The rows --damage=scrollback has appended so far, including the warmup, since
+    // they fill the scrollback all the same. Stream 0 samples them once per stats window.
+    std::atomic<size_t> scrollback_lines{0};
+    std::vector<ScrollbackSample> scrollback_samples;
+    // When the run started, including the warmup. The elapsed times of both the scrollback
+    // and the --monitor samples are measured from here.
+    Stats::clock::time_point run_start;
+
+    // Stream 0 drives the --resize-storm, by resizing its sink between base_cols / base_rows
+    // and a smaller size. resize_sent is the time of the resize in flight, if any, and
+    // resize_from_* are the sizes of the screen at that point, which tell when it arrived.
+    // forced_cols / forced_rows are only used if the sink isn't a terminal: They stand in for it.
+    size_t base_cols = 0;
+    size_t base_rows = 0;
+    size_t forced_cols = 0;
+    size_t forced_rows = 0;
+    size_t resize_from_cols = 0;
+    size_t resize_from_rows = 0;
+    bool resize_shrink = true;
+    Stats::clock::time_point next_resize;
+    Stats::clock::time_point resize_sent;
+    // How long it took from a resize to the first completed frame at the new size.
+    Histogram resize_latencies;
+    size_t resize_timeouts = 0;
+
+    // The --chunk size for frames. --chunk=auto measures each of chunk_candidates for
+    // one stats window, which counts as warmup, and then keeps the fastest of them.
+    size_t chunk = 0;
+    size_t chunk_search = std::size(chunk_candidates);
+    float chunk_mbps[std::size(chunk_candidates)]{};
+
+    // With --precompute, the rows below the status row of each of the rainbow.period distinct
+    // frames, back to back. frame_offsets is empty if they didn't fit.
+    Arena arena;
+    std::vector<size_t> frame_offsets;
+    size_t precomputed_cols = 0;
+    size_t precomputed_rows = 0;
+    size_t precomputed_period = 0;
+    // How much memory the frames need, even if they didn't fit into --precompute's budget.
+    size_t precompute_size = 0;
+};
+
+static void query_size(const Sink& sink, size_t& cols, size_t& rows) noexcept {
+#ifdef _WIN32
+    CONSOLE_SCREEN_BUFFER_INFO info{};
+    GetConsoleScreenBufferInfo(consoleHandles[1], &info);
+    cols = info.dwSize.X;
+    rows = info.dwSize.Y;
+#else
+    winsize size{};
+    ioctl(sink.mode == SinkMode_Tty ? sink.fd : STDOUT_FILENO, TIOCGWINSZ, &size);
+    cols = size.ws_col;
+    rows = size.ws_row;
+#endif
+    // Headless runs may not have a terminal attached at all.
+    if (!cols || !rows) {
+        cols = 120;
+        rows = 30;
+    }
+}
+
+static void layout_stream(const Options& options, Stream& stream) {
+    size_t cols, rows;
+    if (stream.forced_cols) {
+        cols = stream.forced_cols;
+        rows = stream.forced_rows;
+    } else if (options.size_override_cols) {
+        cols = options.size_override_cols;
+        rows = options.size_override_rows;
+    } else {
+        query_size(*stream.sink, cols, rows);
+    }
+    stream.screen_cols = cols;
+    stream.screen_rows = rows;
+
+    if (stream.sink == &console_sink) {
+        // Streams sharing the console split its rows evenly among themselves.
+        const auto beg = stream.index * rows / options.stream_count;
+        const auto end = (stream.index + 1) * rows / options.stream_count;
+        stream.top = beg;
+        rows = end - beg;
+    }
+
+    stream.cols = cols;
+    stream.rows = rows;
+
+    char cup[16] = "\x1b[H"; // Cursor Position (CUP)
+    if (options.damage_mode == DamageMode_Scrollback) {
+        // The rows are appended wherever the cursor is.
+        cup[0] = '\0';
+    } else if (stream.top) {
+        snprintf(&cup[0], std::size(cup), "\x1b[%zuH", stream.top + 1);
+    }
+    stream.header_length = snprintf(
+        &stream.header[0],
+        std::size(stream.header),
+        "%s"
+        "\x1b[39;49m", // Foreground/Background color reset (part of SGR)
+        &cup[0]
+    );
+
+    const auto rebuild_beg = Stats::clock::now();
+    if (stream.rainbow.rebuild(options, cols)) {
+        stream.rebuild_times.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Stats::clock::now() - rebuild_beg).count());
+    }
+
+    // Enough for one CUP sequence per damaged row/cell plus one for the scroll position.
+    stream.scratch.resize((options.damage_count + 1) * 24);
+    stream.random_state = stream.index;
+    stream.status_dirty = true;
+
+    stream.margins_length = 0;
+    if (options.damage_mode == DamageMode_Scroll && rows >= 2 && !options.replay_path) {
+        // Set the scrolling region (DECSTBM) to everything but the status row.
+        stream.margins_length = snprintf(&stream.margins[0], std::size(stream.margins), "\x1b[%zu;%zur", stream.top + 2, stream.top + rows);
+    }
+}
+
+// Writes a CUP sequence for the 0-based coordinates.
+static char* encode_cup(char* p, size_t y, size_t x) noexcept {
+    p = encode_literal(p, "\x1b[");
+    p = std::to_chars(p, p + 20, y + 1).ptr;
+    *p++ = ';';
+    p = std::to_chars(p, p + 20, x + 1).ptr;
+    *p++ = 'H';
+    return p;
+}
+
+// Returns the sequence that begins the synchronized update before the i-th frame, if it starts a batch.
+static std::string_view sync_begin(const Options& options, size_t i) noexcept {
+    if (i % options.sync_batch != 0) {
+        return {};
+    }
+    switch (options.sync_mode) {
+    case SyncMode_2026:
+        return "\033[?2026h"; // begin synchronized update
+    case SyncMode_Dcs:
+        return "\033P=1s\033\\"; // begin synchronized update (DCS form)
+    default:
+        return {};
+    }
+}
+
+// Returns the sequence that ends the synchronized update after the i-th frame, if it ends a batch.
+static std::string_view sync_end(const Options& options, size_t i) noexcept {
+    if ((i + 1) % options.sync_batch != 0) {
+        return {};
+    }
+    switch (options.sync_mode) {
+    case SyncMode_2026:
+        return "\033[?2026l"; // end synchronized update
+    case SyncMode_Dcs:
+        return "\033P=2s\033\\"; // end synchronized update (DCS form)
+    default:
+        return {};
+    }
+}
+
+// Calls append() with the header and status row of the i-th frame and returns the number of cells
+// it contains. The status row is only included for full redraws or if the status changed.
+template<typename Append>
+static size_t compose_status_row(const Options& options, Stream& stream, size_t i, Append&& append) {
+    const auto& rainbow = stream.rainbow;
+    const auto cols = stream.cols;
+    const auto status_length = stream.status_length;
+
+    if (stream.margins_length) {
+        append(&stream.margins[0], stream.margins_length);
+        stream.margins_length = 0;
+    }
+    // The header also moves the cursor to the status row
+    // and the frame continues right there for full redraws.
+    if (const auto begin = sync_begin(options, i); !begin.empty()) {
+        append(begin.data(), begin.size());
+    }
+    append(&stream.header[0], stream.header_length);
+
+    if (options.damage_mode != DamageMode_Full && !stream.status_dirty) {
+        return 0;
+    }
+    if (options.damage_mode == DamageMode_Scrollback) {
+        // There's no fixed place for the status on the main buffer, so it scrolls by like any other row.
+        append("\r\n", 2);
+        stream.scrollback_lines.fetch_add(1, std::memory_order_relaxed);
+    }
+    append(&stream.status_copy[0], status_length);
+    rainbow.slice((i + status_length) % rainbow.period, cols - status_length, append);
+    stream.status_dirty = false;
+    return cols - status_length;
+}
+
+// Calls append() for each consecutive piece of the i-th frame and returns the number
+// of cells it contains. The pieces either get concatenated into a string or submitted
+// as is with write_console_gather().
+template<typename Append>
+static size_t compose_frame(const Options& options, Stream& stream, size_t i, Append&& append) {
+    static constexpr std::string_view reset{
+        "\x1b[39;49m" // Foreground/Background color reset (part of SGR)
+    };
+    static constexpr std::string_view newline{"\r\n"};
+
+    const auto& rainbow = stream.rainbow;
+    const auto cols = stream.cols;
+    const auto rows = stream.rows;
+    auto scratch = stream.scratch.data();
+    size_t cells = compose_status_row(options, stream, i, append);
+
+    const auto append_slice = [&](size_t idx, size_t count) {
+        rainbow.slice(idx % rainbow.period, count, append);
+        cells += count;
+    };
+    const auto append_cup = [&](size_t y, size_t x) {
+        const auto beg = scratch;
+        scratch = encode_cup(scratch, stream.top + y, x);
+        append(beg, scratch - beg);
+    };
+
+    // All damage modes below draw the rows with the same contents that a full redraw would.
+    switch (rows < 2 ? DamageMode_Full : options.damage_mode) {
+    case DamageMode_Full:
+        for (size_t y = 1; y < rows; ++y) {
+            append_slice(i + y * rainbow.row_step, cols);
+        }
+        break;
+    case DamageMode_Rows:
+        for (size_t k = 0, count = std::min(options.damage_count, rows - 1); k < count; ++k) {
+            const auto y = 1 + (i * count + k) % (rows - 1);
+            append_cup(y, 0);
+            append_slice(i + y * rainbow.row_step, cols);
+        }
+        break;
+    case DamageMode_Sparse:
+        for (size_t k = 0; k < options.damage_count; ++k) {
+            const auto y = 1 + next_random(stream.random_state) % (rows - 1);
+            const auto x = next_random(stream.random_state) % cols;
+            // Redraw the entire glyph covering column x, as a 1 column slice of a wide one would only be padding.
+            const auto [idx, cx] = rainbow.cell_at((i + y * rainbow.row_step) % rainbow.period, x);
+            const auto width = rainbow.columns.empty() ? 1 : std::min(rainbow.columns[idx + 1] - rainbow.columns[idx], cols - cx);
+            append_cup(y, cx);
+            rainbow.slice(idx, width, append);
+            cells += width;
+        }
+        break;
+    case DamageMode_Scroll:
+        append_cup(rows - 1, 0);
+        append(reset.data(), reset.size());
+        for (size_t k = 0; k < options.damage_count; ++k) {
+            append(newline.data(), newline.size());
+            append_slice((i * options.damage_count + k) * rainbow.row_step, cols);
+        }
+        break;
+    case DamageMode_Scrollback: {
+        const auto count = options.damage_count ? options.damage_count : rows;
+        for (size_t k = 0; k < count; ++k) {
+            append(newline.data(), newline.size());
+            append_slice((i * count + k) * rainbow.row_step, cols);
+        }
+        stream.scrollback_lines.fetch_add(count, std::memory_order_relaxed);
+        break;
+    }
+    }
+
+    if (const auto end = sync_end(options, i); !end.empty()) {
+        append(end.data(), end.size());
+    }
+    return cells;
+}
+
+// Renders the rows below the status row of all distinct frames into the stream's arena for --precompute.
+// If they exceed the stream's share of the budget, frame_offsets is left empty and frames are sliced as usual.
+static void precompute_frames(const Options& options, Stream& stream) {
+    const auto& rainbow = stream.rainbow;
+    const auto period = rainbow.period;
+    const auto cols = stream.cols;
+    const auto rows = stream.rows;
+
+    stream.precomputed_cols = cols;
+    stream.precomputed_rows = rows;
+    stream.precomputed_period = period;
+    stream.frame_offsets.clear();
+
+    const auto for_each_piece = [&](size_t k, auto&& append) {
+        for (size_t y = 1; y < rows; ++y) {
+            rainbow.slice((k + y * rainbow.row_step) % period, cols, append);
+        }
+    };
+
+    size_t size = 0;
+    for (size_t k = 0; k < period; ++k) {
+        for_each_piece(k, [&](const char*, size_t length) {
+            size += length;
+        });
+    }
+    stream.precompute_size = size;
+
+    if (size > options.precompute_budget / options.stream_count || !stream.arena.reserve(size)) {
+        return;
+    }
+
+    stream.frame_offsets.resize(period + 1);
+    auto p = stream.arena.data;
+    for (size_t k = 0; k < period; ++k) {
+        stream.frame_offsets[k] = p - stream.arena.data;
+        for_each_piece(k, [&](const char* data, size_t length) {
+            memcpy(p, data, length);
+            p += length;
+        });
+    }
+    stream.frame_offsets[period] = p - stream.arena.data;
+}
+
+// Sends a DSR or DA1 query right after a frame, unless there's one in flight already.
+static void send_probe(const Options& options, Stream& stream, Probe::clock::time_point now) noexcept {
+    static constexpr auto timeout = std::chrono::seconds(5);
+    const auto interval = std::chrono::duration_cast<Probe::clock::duration>(std::chrono::duration<double>(options.probe_interval));
+
+    auto sent = probe.sent.load(std::memory_order_relaxed);
+    if (sent) {
+        // The terminal may not support the query, or it got lost among other input.
+        if (now - Probe::clock::time_point{Probe::clock::duration{sent}} < timeout) {
+            return;
+        }
+        if (probe.sent.compare_exchange_strong(sent, 0, std::memory_order_relaxed)) {
+            const std::lock_guard lock{probe.mutex};
+            probe.timeouts++;
+        }
+        return;
+    }
+    if (now - stream.last_probe < interval) {
+        return;
+    }
+
+    stream.last_probe = now;
+    probe.sent.store(now.time_since_epoch().count(), std::memory_order_relaxed);
+    write_console(*stream.sink, options.probe_da1 ? "\x1b[c" : "\x1b[6n");
+}
+
+static void record_frame(const Options& options, Stream& stream, size_t size, size_t cells, Stats::clock::time_point write_beg, Stats::clock::time_point write_end) {
+    // With --pipeline a few more frames may be in flight once we're done.
+    if (stream.done.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    auto& stats = stream.stats;
+    const auto was_warm = stats.warm.load(std::memory_order_relaxed);
+    const auto window_completed = stats.record(size, cells, write_beg, write_end);
+    const auto warm = stats.warm.load(std::memory_order_relaxed);
+    const auto probing = options.probe_interval > 0 && stream.index == 0;
+
+    if (probing) {
+        if (warm && !was_warm) {
+            probe.reset();
+        }
+        send_probe(options, stream, write_end);
+    }
+    if (stream.index == 0 && warm && !was_warm) {
+        io_counters.reset();
+        stream.run_accounting = stream.window_accounting = Accounting::now();
+        stream.monitor_run_cpu = stream.monitor.pid ? stream.monitor.cpu_seconds() : 0;
+    }
+
+    if (warm) {
+        const auto frames = stats.total_frame_times.count + stats.frame_times.count;
+        if ((options.frame_limit && frames >= options.frame_limit) || (options.duration > 0 && std::chrono::duration<double>(write_end - stats.start).count() >= options.duration)) {
+            stream.done.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    if (!window_completed) {
+        return;
+    }
+    stream.published_mbps.store(stats.mbps, std::memory_order_relaxed);
+
+    std::optional<ProcessMonitor::Usage> usage;
+    if (stream.monitor.pid) {
+        usage = stream.monitor.sample();
+        stream.monitor_samples.push_back({
+            std::chrono::duration<double>(write_end - stream.run_start).count(),
+            warm,
+            stats.mbps,
+            stats.fps,
+            *usage,
+        });
+    }
+    if (options.series_path) {
+        SeriesSample sample;
+        sample.unix_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        sample.elapsed = std::chrono::duration<double>(write_end - series.epoch).count();
+        sample.stream = static_cast<uint32_t>(stream.index);
+        sample.warm = warm;
+        sample.fps = stats.fps;
+        sample.mbps = stats.mbps;
+        sample.mcps = stats.mcps;
+        sample.p50_ms = stats.p50_ms;
+        sample.p99_ms = stats.p99_ms;
+        sample.max_ms = stats.max_ms;
+        if (usage) {
+            sample.terminal_cpu_percent = usage->cpu_percent;
+            sample.terminal_rss = usage->rss;
+        }
+        series_ring.push(sample);
+    }
+    if (options.damage_mode == DamageMode_Scrollback && stream.index == 0) {
+        stream.scrollback_samples.push_back({
+            std::chrono::duration<double>(write_end - stream.run_start).count(),
+            stream.scrollback_lines.load(std::memory_order_relaxed),
+            stats.mbps,
+            query_rss(options.terminal_pid),
+        });
+    }
+
+    if (stream.chunk_search < std::size(chunk_candidates)) {
+        stream.chunk_mbps[stream.chunk_search++] = stats.mbps;
+        if (stream.chunk_search < std::size(chunk_candidates)) {
+            stream.chunk = chunk_candidates[stream.chunk_search];
+        } else {
+            const auto best = std::max_element(std::begin(stream.chunk_mbps), std::end(stream.chunk_mbps)) - std::begin(stream.chunk_mbps);
+            stream.chunk = chunk_candidates[best];
+            // The search was the first part of the warmup.
+            stats.warmup_end = write_end + std::chrono::duration_cast<Stats::clock::duration>(std::chrono::duration<double>(options.warmup));
+        }
+    }
+
+    if (options.record_path) {
+        // The status changes with every run, which would make the recordings differ.
+        return;
+    }
+
+    const std::lock_guard lock{stream.status_mutex};
+    auto p = &stream.status[0];
+    const auto end = p + std::size(stream.status);
+    if (options.stream_count > 1) {
+        format_append(p, end, "[%zu] ", stream.index);
+    }
+    p += stats.format(p, end - p);
+    p = std::min(p, end - 1);
+    if (!stream.peers.empty()) {
+        float total = 0;
+        for (const auto& peer : stream.peers) {
+            total += peer.published_mbps.load(std::memory_order_relaxed);
+        }
+        format_append(p, end, " | total %.3f MB/s", total);
+    }
+    if (stream.index == 0) {
+        // The CPU and write times cover all threads, which is why they can add up to more than 100%.
+        const auto now = Accounting::now();
+        const auto& prev = stream.window_accounting;
+        const auto wall = std::max(std::chrono::duration<double>(now.time - prev.time).count(), 1e-9);
+        format_append(
+            p,
+            end,
+            " | cpu %.0f%% usr %.0f%% sys | blocked %.0f%%",
+            (now.cpu.user - prev.cpu.user) / wall * 100,
+            (now.cpu.sys - prev.cpu.sys) / wall * 100,
+            (now.blocked_ns - prev.blocked_ns) / 1e9 / wall * 100
+        );
+        stream.window_accounting = now;
+    }
+    if (usage) {
+        format_append(p, end, " | term cpu %.0f%% %.0f MB", usage->cpu_percent, usage->rss / 1e6);
+        if (usage->gpu_percent >= 0) {
+            format_append(p, end, " gpu %.0f%%", usage->gpu_percent);
+        }
+    }
+    if (probing) {
+        const std::lock_guard probe_lock{probe.mutex};
+        const auto& h = probe.latencies;
+        format_append(p, end, " | probe p50 %.2f | p99 %.2f | max %.2f ms", h.percentile(50) / 1e6, h.percentile(99) / 1e6, h.max / 1e6);
+        probe.total_latencies.merge(h);
+        probe.latencies.reset();
+    }
+    if (options.target_fps > 0) {
+        format_append(p, end, " | missed %zu", stream.missed_deadlines.load(std::memory_order_relaxed));
+    }
+    if (options.resize_interval > 0 && stream.index == 0) {
+        format_append(p, end, " | %zux%zu", stream.screen_cols, stream.screen_rows);
+    }
+    if (options.chunk || options.chunk_auto) {
+        const auto searching = stream.chunk_search < std::size(chunk_candidates);
+        char chunk[32];
+        format_append(p, end, " | chunk %s%s", format_chunk(chunk, stream.chunk), searching ? " (searching)" : "");
+    }
+
+    if (stream.sink->mode != SinkMode_Console && stream.index == 0) {
+        // Nobody gets to see the stats embedded in the frames, so we print them separately.
+        fprintf(stderr, "\r%s\x1b[K", &stream.status[0]);
+    }
+}
+
+static void submit_frame(const Options& options, Stream& stream, const std::string_view& frame, size_t cells) {
+    const auto write_beg = Stats::clock::now();
+    write_console(*stream.sink, frame, stream.chunk);
+    record_frame(options, stream, frame.size(), cells, write_beg, Stats::clock::now());
+}
+
+// Writes the next frame of the --replay capture, wrapped in a synchronized update like the rainbow frames.
+// The frames are the capture's bytes as is, straight from the mapping, which only needs to be scanned
+// for the newlines that end them. Frames don't straddle the end of the capture, which starts over.
+static void replay_frame(const Options& options, Stream& stream, size_t i) {
+    const auto begin = sync_begin(options, i);
+    const auto trailer = sync_end(options, i);
+    const auto data = replay_file.data;
+    const auto size = replay_file.size;
+    const auto beg = stream.replay_offset;
+    auto end = size;
+
+    if (options.replay_frame) {
+        end = std::min(size, beg + options.replay_frame);
+    } else {
+        auto p = data + beg;
+        for (size_t lines = 0; lines < stream.screen_rows && p; ++lines) {
+            p = static_cast<const char*>(memchr(p, '\n', data + size - p));
+            if (p) {
+                p++;
+            }
+        }
+        if (p) {
+            end = p - data;
+        }
+    }
+    if (end >= size) {
+        end = size;
+        stream.replay_offset = 0;
+        stream.replay_loops++;
+    } else {
+        stream.replay_offset = end;
+    }
+
+    const iovec iov[3]{
+        {const_cast<char*>(begin.data()), begin.size()},
+        {const_cast<char*>(data + beg), end - beg},
+        {const_cast<char*>(trailer.data()), trailer.size()},
+    };
+    const auto write_beg = Stats::clock::now();
+    write_console_gather(*stream.sink, &iov[0], 3, stream.chunk);
+    record_frame(options, stream, begin.size() + (end - beg) + trailer.size(), 0, write_beg, Stats::clock::now());
+}
+
+static void render_frame(const Options& options, Stream& stream, size_t i) {
+    if (!stream.rows) {
+        // There are more streams than rows on the console.
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return;
+    }
+    if (options.replay_path) {
+        replay_frame(options, stream, i);
+        return;
+    }
+
+    {
+        const std::lock_guard lock{stream.status_mutex};
+        const auto length = std::min(strlen(&stream.status[0]), stream.cols);
+        if (length != stream.status_length || memcmp(&stream.status_copy[0], &stream.status[0], length) != 0) {
+            memcpy(&stream.status_copy[0], &stream.status[0], length);
+            stream.status_length = length;
+            stream.status_dirty = true;
+        }
+    }
+
+    if (options.precompute_budget) {
+        if (stream.precomputed_cols != stream.cols || stream.precomputed_rows != stream.rows || stream.precomputed_period != stream.rainbow.period) {
+            precompute_frames(options, stream);
+        }
+    }
+
+    if (!stream.frame_offsets.empty()) {
+        // Only the status row is composed, the rest is a single piece of the arena.
+        stream.output.clear();
+        const auto cells = compose_status_row(options, stream, i, [&](const char* data, size_t size) {
+            stream.output.append(data, size);
+        });
+        const auto k = i % stream.rainbow.period;
+        const auto beg = stream.frame_offsets[k];
+        const auto end = stream.frame_offsets[k + 1];
+        const auto trailer = sync_end(options, i);
+        const iovec iov[3]{
+            {stream.output.data(), stream.output.size()},
+            {stream.arena.data + beg, end - beg},
+            {const_cast<char*>(trailer.data()), trailer.size()},
+        };
+
+        const auto write_beg = Stats::clock::now();
+        write_console_gather(*stream.sink, &iov[0], trailer.empty() ? 2 : 3, stream.chunk);
+        record_frame(options, stream, iov[0].iov_len + iov[1].iov_len + iov[2].iov_len, cells + (stream.rows - 1) * stream.cols, write_beg, Stats::clock::now());
+    } else if (options.use_pipeline) {
+        auto& slot = stream.ring.acquire();
+        slot.data.clear();
+        slot.cells = compose_frame(options, stream, i, [&](const char* data, size_t size) {
+            slot.data.append(data, size);
+        });
+        stream.ring.publish();
+    } else if (options.use_writev) {
+        size_t frame_size = 0;
+        stream.segments.clear();
+        const auto cells = compose_frame(options, stream, i, [&](const char* data, size_t size) {
+            stream.segments.push_back({const_cast<char*>(data), size});
+            frame_size += size;
+        });
+
+        const auto write_beg = Stats::clock::now();
+        write_console_gather(*stream.sink, stream.segments.data(), stream.segments.size(), stream.chunk);
+        record_frame(options, stream, frame_size, cells, write_beg, Stats::clock::now());
+    } else {
+        stream.output.clear();
+        const auto cells = compose_frame(options, stream, i, [&](const char* data, size_t size) {
+            stream.output.append(data, size);
+        });
+        submit_frame(options, stream, stream.output, cells);
+    }
+}
+
+// Sleeps for the duration with a precision of well below a millisecond.
+static void precise_sleep(Stats::clock::duration duration) noexcept {
+#if defined(_WIN32) && defined(CREATE_WAITABLE_TIMER_HIGH_RESOLUTION)
+    // Sleep() is at the mercy of the 15.6ms default timer resolution, unlike high resolution timers.
+    static thread_local const auto timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (timer) {
+        LARGE_INTEGER due;
+        due.QuadPart = -std::max<LONGLONG>(1, std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / 100);
+        if (SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE)) {
+            WaitForSingleObject(timer, INFINITE);
+            return;
+        }
+    }
+#endif
+    std::this_thread::sleep_for(duration);
+}
+
+// Waits for the next --fps deadline of the stream, by sleeping until shortly before it and spinning
+// for the rest. The sleep is sliced, so that signals are handled promptly even at low rates. Returns
+// the accumulated state of the poll() calls. A frame that starts a period or more after its deadline
+// has missed it and, like a display would, the next frame is scheduled for the upcoming slot instead.
+template<typename Poll>
+static uint8_t pace_frame(const Options& options, Stream& stream, Poll& poll) {
+#ifdef _WIN32
+    static constexpr auto spin_margin = std::chrono::milliseconds(1);
+#else
+    static constexpr auto spin_margin = std::chrono::microseconds(200);
+#endif
+    static constexpr auto max_slice = std::chrono::milliseconds(10);
+    const auto period = std::chrono::duration_cast<Stats::clock::duration>(std::chrono::duration<double>(1.0 / options.target_fps));
+
+    uint8_t state = 0;
+    auto now = Stats::clock::now();
+    if (stream.deadline == Stats::clock::time_point{}) {
+        stream.deadline = now;
+    }
+
+    while (now + spin_margin < stream.deadline) {
+        state |= poll();
+        if (state & SignalState_Sigint) {
+            return state;
+        }
+        precise_sleep(std::min<Stats::clock::duration>(stream.deadline - now - spin_margin, max_slice));
+        now = Stats::clock::now();
+    }
+    while (now < stream.deadline) {
+        now = Stats::clock::now();
+    }
+    state |= poll();
+
+    if (!stream.stats.warm.load(std::memory_order_acquire)) {
+        stream.missed_deadlines.store(0, std::memory_order_relaxed);
+        stream.lateness.reset();
+    }
+    if (now - stream.deadline >= period) {
+        const auto skipped = (now - stream.deadline) / period;
+        stream.missed_deadlines.fetch_add(skipped, std::memory_order_relaxed);
+        stream.deadline += skipped * period;
+    }
+    stream.lateness.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - stream.deadline).count());
+    stream.deadline += period;
+    return state;
+}
+
+// Whether the --resize-storm can ask a terminal to resize itself. Otherwise it's simulated.
+static bool can_request_resize(const Options& options, const Stream& stream) noexcept {
+    return !options.size_override_cols && (stream.sink->mode == SinkMode_Console || stream.sink->mode == SinkMode_Tty);
+}
+
+// Asks the sink to resize itself to the given size. Terminals report
+// back with the usual SIGWINCH or WINDOW_BUFFER_SIZE_EVENT, if they comply.
+static void request_resize(const Options& options, Stream& stream, size_t cols, size_t rows) {
+    if (!can_request_resize(options, stream)) {
+        stream.forced_cols = cols;
+        stream.forced_rows = rows;
+        layout_stream(options, stream);
+        return;
+    }
+#ifdef _WIN32
+    if (stream.sink == &console_sink) {
+        CONSOLE_SCREEN_BUFFER_INFOEX info{};
+        info.cbSize = sizeof(info);
+        if (GetConsoleScreenBufferInfoEx(consoleHandles[1], &info)) {
+            // The window has to fit into the buffer at all times, so shrink it first.
+            const SMALL_RECT window{0, 0, static_cast<SHORT>(std::min<size_t>(cols, info.dwSize.X) - 1), static_cast<SHORT>(std::min<size_t>(rows, info.dwSize.Y) - 1)};
+            SetConsoleWindowInfo(consoleHandles[1], TRUE, &window);
+            info.dwSize = {static_cast<SHORT>(cols), static_cast<SHORT>(rows)};
+            // SetConsoleScreenBufferInfoEx() treats the window's right/bottom as exclusive, unlike Get.
+            info.srWindow = {0, 0, static_cast<SHORT>(cols), static_cast<SHORT>(rows)};
+            SetConsoleScreenBufferInfoEx(consoleHandles[1], &info);
+        }
+        return;
+    }
+#endif
+    // XTWINOPS: Resize the text area to the given rows and columns.
+    char buffer[32];
+    const auto length = snprintf(&buffer[0], std::size(buffer), "\x1b[8;%zu;%zut", rows, cols);
+    write_console(*stream.sink, {&buffer[0], static_cast<size_t>(length)});
+}
+
+// Called by stream 0 after each frame during a --resize-storm. A frame counts as the first one after
+// a resize if it's drawn at a different size than the one before the resize. Terminals that ignore the
+// resize, or that can't resize to the exact size, are given until the next resize to react.
+static void drive_resize_storm(const Options& options, Stream& stream) {
+    const auto now = Stats::clock::now();
+    const auto interval = std::chrono::duration_cast<Stats::clock::duration>(std::chrono::duration<double>(options.resize_interval));
+
+    if (!stream.stats.warm.load(std::memory_order_acquire)) {
+        stream.resize_latencies.reset();
+        stream.resize_timeouts = 0;
+    }
+    if (stream.resize_sent != Stats::clock::time_point{}) {
+        if (stream.screen_cols != stream.resize_from_cols || stream.screen_rows != stream.resize_from_rows) {
+            stream.resize_latencies.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - stream.resize_sent).count());
+        } else if (now - stream.resize_sent >= interval) {
+            stream.resize_timeouts++;
+        } else {
+            return;
+        }
+        stream.resize_sent = {};
+    }
+    if (now < stream.next_resize) {
+        return;
+    }
+
+    const auto cols = stream.resize_shrink ? std::max<size_t>(stream.base_cols * 2 / 3, 1) : stream.base_cols;
+    const auto rows = stream.resize_shrink ? std::max<size_t>(stream.base_rows * 2 / 3, 1) : stream.base_rows;
+    stream.resize_shrink = !stream.resize_shrink;
+    stream.resize_from_cols = stream.screen_cols;
+    stream.resize_from_rows = stream.screen_rows;
+    stream.next_resize = now + interval;
+    stream.resize_sent = Stats::clock::now();
+    request_resize(options, stream, cols, rows);
+}
+
+// Renders frames until poll() reports SignalState_Sigint or the stream is done.
+// SignalState_Sigwinch makes the stream re-query the size of its sink.
+// Returns true if the stream got interrupted.
+template<typename Poll>
+static bool run_stream(const Options& options, Stream& stream, Poll&& poll) {
+    layout_stream(options, stream);
+    if (options.precompute_budget) {
+        precompute_frames(options, stream);
+    }
+    stream.stats.restart(Stats::clock::now());
+    stream.run_start = stream.stats.start;
+    if (stream.index == 0) {
+        if (options.monitor) {
+            // The terminal may have exited since main() checked it. Sampling it anyway would record 0% and 0 MB.
+            if (stream.monitor.open(options.terminal_pid)) {
+                stream.monitor_run_cpu = stream.monitor.cpu_seconds();
+            } else {
+                stream.monitor.close();
+            }
+        }
+        stream.run_accounting = stream.window_accounting = Accounting::now();
+    }
+    const auto storming = options.resize_interval > 0 && stream.index == 0;
+    if (storming) {
+        stream.base_cols = stream.screen_cols;
+        stream.base_rows = stream.screen_rows;
+        stream.next_resize = stream.stats.start;
+    }
+    stream.chunk = options.chunk;
+    if (options.chunk_auto) {
+        stream.chunk_search = 0;
+        stream.chunk = chunk_candidates[0];
+        stream.stats.warm.store(false, std::memory_order_relaxed);
+        stream.stats.warmup_end = Stats::clock::time_point::max();
+    }
+
+    if (options.use_pipeline) {
+        stream.writer = std::thread([&]() noexcept {
+            for (;;) {
+                const auto& frame = stream.ring.peek();
+                if (frame.data.empty()) {
+                    break;
+                }
+                submit_frame(options, stream, frame.data, frame.cells);
+                stream.ring.pop();
+            }
+        });
+    }
+
+    bool interrupted = false;
+
+    for (size_t i = 0;; ++i) {
+        const auto state = options.target_fps > 0 ? pace_frame(options, stream, poll) : poll();
+        if (state & SignalState_Sigint) {
+            interrupted = true;
+            break;
+        }
+        if (stream.done.load(std::memory_order_relaxed)) {
+            break;
+        }
+        if (state & SignalState_Sigwinch) {
+            layout_stream(options, stream);
+        }
+        render_frame(options, stream, i);
+        if (storming) {
+            drive_resize_storm(options, stream);
+        }
+    }
+
+    if (storming && can_request_resize(options, stream) && (stream.screen_cols != stream.base_cols || stream.screen_rows != stream.base_rows)) {
+        request_resize(options, stream, stream.base_cols, stream.base_rows);
+    }
+
+    if (options.use_pipeline) {
+        stream.ring.close();
+        stream.writer.join();
+    }
+    if (options.sync_batch > 1) {
+        // The last batch may not be complete. Ending an update that isn't open is harmless.
+        const auto end = sync_end(options, options.sync_batch - 1);
+        write_console(*stream.sink, end);
+    }
+    stream.stats.finish();
+    return interrupted;
+}
+
+// The outcome of a benchmark run, aggregated over all of its streams.
+struct Result {
+    Histogram frame_times;
+    size_t written = 0;
+    size_t cells = 0;
+    double elapsed = 0;
+    // The size of the terminal (or --size).
+    size_t cols = 0;
+    size_t rows = 0;
+    bool interrupted = false;
+    // Round trip times of the --probe queries.
+    Histogram probe_times;
+    size_t probe_timeouts = 0;
+    // --fps deadlines that were missed and how late the frames started.
+    size_t missed_deadlines = 0;
+    Histogram lateness;
+    // The --resize-storm's time from each resize to the first frame at the new size.
+    Histogram resize_times;
+    size_t resize_timeouts = 0;
+    // The durations of the rainbow rebuilds, including the initial one, over all streams.
+    Histogram rebuild_times;
+    // The CPU time of the process, the time its threads were blocked in write syscalls
+    // and the wall time they're measured over, in seconds. All of them exclude the warmup.
+    double user_time = 0;
+    double sys_time = 0;
+    double blocked_time = 0;
+    double accounting_elapsed = 0;
+    // The size of the --replay capture and how often it was written in full, over all streams.
+    size_t replay_bytes = 0;
+    size_t replay_loops = 0;
+    // --monitor: The terminal's CPU time since the warmup and stream 0's samples of it.
+    double terminal_cpu_time = 0;
+    std::vector<MonitorSample> monitor_samples;
+    // --damage=scrollback: The rows appended by all streams and stream 0's samples over time.
+    size_t scrollback_lines = 0;
+    std::vector<ScrollbackSample> scrollback_samples;
+    uint64_t writes = 0;
+    uint64_t partial_writes = 0;
+    uint64_t failed_writes = 0;
+    // The --chunk size of the first stream, which --chunk=auto may have picked.
+    size_t chunk = 0;
+    // The memory the --precompute frames of all streams need and whether they fit into the budget.
+    size_t precompute_size = 0;
+    bool precomputed = true;
+    const char* precompute_backing = "none";
+
+    void add(const Stats& stats) noexcept {
+        frame_times.merge(stats.total_frame_times);
+        written += stats.total_written;
+        cells += stats.total_cells;
+    }
+
+    double fps() const noexcept {
+        return elapsed > 0 ? frame_times.count / elapsed : 0;
+    }
+
+    double mbps() const noexcept {
+        return elapsed > 0 ? written / elapsed / 1e6 : 0;
+    }
+
+    double cells_per_second() const noexcept {
+        return elapsed > 0 ? cells / elapsed : 0;
+    }
+
+    double bytes_per_cell() const noexcept {
+        return cells ? double(written) / double(cells) : 0;
+    }
+
+    // The terminal's CPU time per MB written, its peak RSS and its average GPU usage after the warmup (negative if unknown).
+    double terminal_cpu_ms_per_mb() const noexcept {
+        return written ? terminal_cpu_time * 1e3 / (written / 1e6) : 0;
+    }
+
+    size_t terminal_rss_peak() const noexcept {
+        size_t peak = 0;
+        for (const auto& sample : monitor_samples) {
+            peak = std::max(peak, sample.usage.rss);
+        }
+        return peak;
+    }
+
+    double terminal_gpu_percent() const noexcept {
+        double sum = 0;
+        size_t count = 0;
+        for (const auto& sample : monitor_samples) {
+            if (sample.warm && sample.usage.gpu_percent >= 0) {
+                sum += sample.usage.gpu_percent;
+                count++;
+            }
+        }
+        return count ? sum / count : -1;
+    }
+};
+
+static const char* color_mode_name(ColorMode mode) noexcept {
+    switch (mode) {
+    case ColorMode_All:
+        return "all";
+    case ColorMode_Foreground:
+        return "fg";
+    case ColorMode_Background:
+        return "bg";
+    default:
+        return "none";
+    }
+}
+
+static const char* damage_mode_name(DamageMode mode) noexcept {
+    switch (mode) {
+    case DamageMode_Rows:
+        return "rows";
+    case DamageMode_Sparse:
+        return "sparse";
+    case DamageMode_Scroll:
+        return "scroll";
+    case DamageMode_Scrollback:
+        return "scrollback";
+    default:
+        return "full";
+    }
+}
+
+static const char* palette_name(Palette palette) noexcept {
+    switch (palette) {
+    case Palette_256:
+        return "256";
+    case Palette_16:
+        return "16";
+    default:
+        return "truecolor";
+    }
+}
+
+static const char* glyph_set_name(GlyphSet set) noexcept {
+    switch (set) {
+    case GlyphSet_Cjk:
+        return "cjk";
+    case GlyphSet_Combining:
+        return "combining";
+    case GlyphSet_Emoji:
+        return "emoji";
+    case GlyphSet_Mixed:
+        return "mixed";
+    default:
+        return "ascii";
+    }
+}
+
+static const char* sync_mode_name(SyncMode mode) noexcept {
+    switch (mode) {
+    case SyncMode_None:
+        return "none";
+    case SyncMode_Dcs:
+        return "dcs";
+    default:
+        return "2026";
+    }
+}
+
+static const char* sgr_mode_name(SgrMode mode) noexcept {
+    return mode == SgrMode_Minimal ? "minimal" : "full";
+}
+
+// Formats the attributes as e.g. "bold+link", or "none". The '+' keeps them a single CSV field.
+static const char* format_attributes(char (&buffer)[64], uint8_t attributes) noexcept {
+    auto p = &buffer[0];
+    for (size_t k = 0; k < std::size(attribute_names); ++k) {
+        if (attributes & (1 << k)) {
+            if (p != &buffer[0]) {
+                *p++ = '+';
+            }
+            memcpy(p, attribute_names[k].data(), attribute_names[k].size());
+            p += attribute_names[k].size();
+        }
+    }
+    if (p == &buffer[0]) {
+        p = encode_literal(p, "none");
+    }
+    *p = '\0';
+    return &buffer[0];
+}
+
+static const char* sink_mode_name(SinkMode mode) noexcept {
+    switch (mode) {
+    case SinkMode_Null:
+        return "null";
+    case SinkMode_Pipe:
+        return "pipe";
+    case SinkMode_Discard:
+        return "discard";
+    case SinkMode_File:
+        return "file";
+    default:
+        return "console";
+    }
+}
+
+static void print_report(const char* label, const Histogram& frame_times, size_t written, size_t cells, double elapsed) noexcept {
+    char latencies[128];
+    format_latencies(&latencies[0], std::size(latencies), frame_times);
+    fprintf(
+        stderr,
+        "%s%" PRIu64 " frames in %.1fs | %.1f fps | %.3f MB/s | %.2f Mcells/s | %.1f B/cell\n"
+        "%sframe time: %s\n",
+        label,
+        frame_times.count,
+        elapsed,
+        elapsed > 0 ? frame_times.count / elapsed : 0,
+        elapsed > 0 ? written / elapsed / 1e6 : 0,
+        elapsed > 0 ? cells / elapsed / 1e6 : 0,
+        cells ? double(written) / double(cells) : 0,
+        label,
+        &latencies[0]
+    );
+}
+
+static void write_json_string(FILE* file, const char* str) noexcept {
+    fputc('"', file);
+    for (; *str; ++str) {
+        const auto ch = static_cast<unsigned char>(*str);
+        if (ch == '"' || ch == '\\') {
+            fprintf(file, "\\%c", ch);
+        } else if (ch < 0x20) {
+            fprintf(file, "\\u%04x", ch);
+        } else {
+            fputc(ch, file);
+        }
+    }
+    fputc('"', file);
+}
+
+// Writes the result to --report as either a JSON object on one line, or as a CSV row preceded by the header
+// if `header` is set. Sweeps and --runs write one such line per run, `step` being the label of its sweep step
+// and `iteration` which of the step's --runs it is.
+static void write_report(FILE* file, const Options& options, const Result& result, bool header, const std::string& step, size_t iteration) noexcept {
+    const auto& h = result.frame_times;
+    char attributes[64];
+    if (options.report_csv) {
+        if (header) {
+            fprintf(file, "fps,mbps,cells_per_second,frames,bytes,duration,p50_ms,p90_ms,p99_ms,p99.9_ms,max_ms,jitter_ms,cols,rows,num_colors,color_mode,damage,streams,sink,sgr,run,palette,glyphs,unique_glyphs,bytes_per_cell,writes,partial_writes,failed_writes,chunk,user_cpu_s,sys_cpu_s,blocked_s,cpu_wall_s,sync,sync_batch,attrs,attr_density,rebuilds,rebuild_max_ms");
+            if (options.probe_interval > 0) {
+                fprintf(file, ",probe_p50_ms,probe_p99_ms,probe_max_ms,probes,probe_timeouts");
+            }
+            if (options.precompute_budget) {
+                fprintf(file, ",precompute_bytes,precomputed,precompute_backing");
+            }
+            if (options.target_fps > 0) {
+                fprintf(file, ",target_fps,missed_deadlines,lateness_p50_ms,lateness_p99_ms,lateness_max_ms");
+            }
+            if (options.resize_interval > 0) {
+                fprintf(file, ",resize_interval_ms,resizes,resize_timeouts,resize_p50_ms,resize_p99_ms,resize_max_ms");
+            }
+            if (options.damage_mode == DamageMode_Scrollback) {
+                fprintf(file, ",scrollback_rows,terminal_pid,terminal_rss_first_mb,terminal_rss_last_mb");
+            }
+            if (options.replay_path) {
+                fprintf(file, ",replay_bytes,replay_frame,replay_loops");
+            }
+            if (options.monitor) {
+                fprintf(file, ",monitor_pid,terminal_cpu_s,terminal_cpu_ms_per_mb,terminal_rss_peak_mb,terminal_gpu_percent");
+            }
+            if (options.runs > 1) {
+                fprintf(file, ",step,iteration");
+            }
+            fprintf(file, "\n");
+        }
+        fprintf(
+            file,
+            "%.3f,%.6f,%.0f,%" PRIu64 ",%zu,%.3f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%zu,%zu,%zu,%s,%s,%zu,%s,%s,%zu,%s,%s,%zu,%.3f,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%zu,%.4f,%.4f,%.4f,%.4f,%s,%zu,%s,%zu,%" PRIu64 ",%.4f",
+            result.fps(),
+            result.mbps(),
+            result.cells_per_second(),
+            h.count,
+            result.written,
+            result.elapsed,
+            h.percentile(50) / 1e6,
+            h.percentile(90) / 1e6,
+            h.percentile(99) / 1e6,
+            h.percentile(99.9) / 1e6,
+            h.max / 1e6,
+            h.stddev() / 1e6,
+            result.cols,
+            result.rows,
+            options.num_colors,
+            color_mode_name(options.color_mode),
+            damage_mode_name(options.damage_mode),
+            options.stream_count,
+            sink_mode_name(console_sink.mode),
+            sgr_mode_name(options.sgr_mode),
+            options.run_length,
+            palette_name(options.palette),
+            glyph_set_name(options.glyph_set),
+            options.unique_glyphs,
+            result.bytes_per_cell(),
+            result.writes,
+            result.partial_writes,
+            result.failed_writes,
+            result.chunk,
+            result.user_time,
+            result.sys_time,
+            result.blocked_time,
+            result.accounting_elapsed,
+            sync_mode_name(options.sync_mode),
+            options.sync_batch,
+            format_attributes(attributes, options.attributes),
+            options.attributes ? options.attribute_density : 0,
+            result.rebuild_times.count,
+            result.rebuild_times.max / 1e6
+        );
+        if (options.probe_interval > 0) {
+            const auto& p = result.probe_times;
+            fprintf(file, ",%.4f,%.4f,%.4f,%" PRIu64 ",%zu", p.percentile(50) / 1e6, p.percentile(99) / 1e6, p.max / 1e6, p.count, result.probe_timeouts);
+        }
+        if (options.precompute_budget) {
+            fprintf(file, ",%zu,%d,%s", result.precompute_size, result.precomputed, result.precompute_backing);
+        }
+        if (options.target_fps > 0) {
+            const auto& l = result.lateness;
+            fprintf(file, ",%.3f,%zu,%.4f,%.4f,%.4f", options.target_fps, result.missed_deadlines, l.percentile(50) / 1e6, l.percentile(99) / 1e6, l.max / 1e6);
+        }
+        if (options.resize_interval > 0) {
+            const auto& r = result.resize_times;
+            fprintf(file, ",%.3f,%" PRIu64 ",%zu,%.4f,%.4f,%.4f", options.resize_interval * 1e3, r.count, result.resize_timeouts, r.percentile(50) / 1e6, r.percentile(99) / 1e6, r.max / 1e6);
+        }
+        if (options.damage_mode == DamageMode_Scrollback) {
+            const auto& samples = result.scrollback_samples;
+            const auto first = samples.empty() ? 0 : samples.front().terminal_rss;
+            const auto last = samples.empty() ? 0 : samples.back().terminal_rss;
+            fprintf(file, ",%zu,%ld,%.3f,%.3f", result.scrollback_lines, options.terminal_pid, first / 1e6, last / 1e6);
+        }
+        if (options.replay_path) {
+            fprintf(file, ",%zu,%zu,%zu", result.replay_bytes, options.replay_frame, result.replay_loops);
+        }
+        if (options.monitor) {
+            fprintf(file, ",%ld,%.4f,%.4f,%.3f,%.2f", options.terminal_pid, result.terminal_cpu_time, result.terminal_cpu_ms_per_mb(), result.terminal_rss_peak() / 1e6, result.terminal_gpu_percent());
+        }
+        if (options.runs > 1) {
+            fprintf(file, ",%s,%zu", step.c_str(), iteration);
+        }
+        fprintf(file, "\n");
+    } else {
+        fprintf(
+            file,
+            "{\"fps\":%.3f,\"mbps\":%.6f,\"cells_per_second\":%.0f,\"frames\":%" PRIu64 ",\"bytes\":%zu,\"duration\":%.3f,"
+            "\"frame_time_ms\":{\"p50\":%.4f,\"p90\":%.4f,\"p99\":%.4f,\"p99.9\":%.4f,\"max\":%.4f,\"jitter\":%.4f},"
+            "\"cols\":%zu,\"rows\":%zu,\"num_colors\":%zu,\"color_mode\":\"%s\",\"damage\":\"%s\",\"streams\":%zu,\"sink\":\"%s\","
+            "\"sgr\":\"%s\",\"run\":%zu,\"palette\":\"%s\",\"glyphs\":\"%s\",\"unique_glyphs\":%zu,\"bytes_per_cell\":%.3f,"
+            "\"writes\":{\"syscalls\":%" PRIu64 ",\"partial\":%" PRIu64 ",\"failed\":%" PRIu64 "},\"chunk\":%zu,"
+            "\"cpu\":{\"user_s\":%.4f,\"sys_s\":%.4f,\"blocked_s\":%.4f,\"wall_s\":%.4f},\"sync\":\"%s\",\"sync_batch\":%zu,\"attrs\":\"%s\",\"attr_density\":%zu,"
+            "\"rebuild\":{\"count\":%" PRIu64 ",\"p50_ms\":%.4f,\"max_ms\":%.4f}",
+            result.fps(),
+            result.mbps(),
+            result.cells_per_second(),
+            h.count,
+            result.written,
+            result.elapsed,
+            h.percentile(50) / 1e6,
+            h.percentile(90) / 1e6,
+            h.percentile(99) / 1e6,
+            h.percentile(99.9) / 1e6,
+            h.max / 1e6,
+            h.stddev() / 1e6,
+            result.cols,
+            result.rows,
+            options.num_colors,
+            color_mode_name(options.color_mode),
+            damage_mode_name(options.damage_mode),
+            options.stream_count,
+            sink_mode_name(console_sink.mode),
+            sgr_mode_name(options.sgr_mode),
+            options.run_length,
+            palette_name(options.palette),
+            glyph_set_name(options.glyph_set),
+            options.unique_glyphs,
+            result.bytes_per_cell(),
+            result.writes,
+            result.partial_writes,
+            result.failed_writes,
+            result.chunk,
+            result.user_time,
+            result.sys_time,
+            result.blocked_time,
+            result.accounting_elapsed,
+            sync_mode_name(options.sync_mode),
+            options.sync_batch,
+            format_attributes(attributes, options.attributes),
+            options.attributes ? options.attribute_density : 0,
+            result.rebuild_times.count,
+            result.rebuild_times.percentile(50) / 1e6,
+            result.rebuild_times.max / 1e6
+        );
+        if (options.probe_interval > 0) {
+            const auto& p = result.probe_times;
+            fprintf(
+                file,
+                ",\"probe_ms\":{\"p50\":%.4f,\"p99\":%.4f,\"max\":%.4f,\"count\":%" PRIu64 ",\"timeouts\":%zu}",
+                p.percentile(50) / 1e6,
+                p.percentile(99) / 1e6,
+                p.max / 1e6,
+                p.count,
+                result.probe_timeouts
+            );
+        }
+        if (options.precompute_budget) {
+            fprintf(
+                file,
+                ",\"precompute\":{\"bytes\":%zu,\"precomputed\":%s,\"backing\":\"%s\"}",
+                result.precompute_size,
+                result.precomputed ? "true" : "false",
+                result.precompute_backing
+            );
+        }
+        if (options.target_fps > 0) {
+            const auto& l = result.lateness;
+            fprintf(
+                file,
+                ",\"pacing\":{\"target_fps\":%.3f,\"missed\":%zu,\"lateness_ms\":{\"p50\":%.4f,\"p99\":%.4f,\"max\":%.4f}}",
+                options.target_fps,
+                result.missed_deadlines,
+                l.percentile(50) / 1e6,
+                l.percentile(99) / 1e6,
+                l.max / 1e6
+            );
+        }
+        if (options.resize_interval > 0) {
+            const auto& r = result.resize_times;
+            fprintf(
+                file,
+                ",\"resize_storm\":{\"interval_ms\":%.3f,\"resizes\":%" PRIu64 ",\"unanswered\":%zu,\"first_frame_ms\":{\"p50\":%.4f,\"p99\":%.4f,\"max\":%.4f}}",
+                options.resize_interval * 1e3,
+                r.count,
+                result.resize_timeouts,
+                r.percentile(50) / 1e6,
+                r.percentile(99) / 1e6,
+                r.max / 1e6
+            );
+        }
+        if (options.damage_mode == DamageMode_Scrollback) {
+            fprintf(file, ",\"scrollback\":{\"rows\":%zu,\"terminal_pid\":%ld,\"samples\":[", result.scrollback_lines, options.terminal_pid);
+            for (size_t i = 0; i < result.scrollback_samples.size(); ++i) {
+                const auto& sample = result.scrollback_samples[i];
+                fprintf(
+                    file,
+                    "%s{\"t\":%.3f,\"rows\":%zu,\"mbps\":%.3f,\"terminal_rss_mb\":%.3f}",
+                    i ? "," : "",
+                    sample.elapsed,
+                    sample.lines,
+                    sample.mbps,
+                    sample.terminal_rss / 1e6
+                );
+            }
+            fprintf(file, "]}");
+        }
+        if (options.replay_path) {
+            fprintf(file, ",\"replay\":{\"file\":");
+            write_json_string(file, options.replay_path);
+            fprintf(file, ",\"bytes\":%zu,\"frame\":%zu,\"loops\":%zu}", result.replay_bytes, options.replay_frame, result.replay_loops);
+        }
+        if (options.monitor) {
+            fprintf(
+                file,
+                ",\"monitor\":{\"pid\":%ld,\"cpu_s\":%.4f,\"cpu_ms_per_mb\":%.4f,\"rss_peak_mb\":%.3f,\"gpu_percent\":%.2f,\"samples\":[",
+                options.terminal_pid,
+                result.terminal_cpu_time,
+                result.terminal_cpu_ms_per_mb(),
+                result.terminal_rss_peak() / 1e6,
+                result.terminal_gpu_percent()
+            );
+            for (size_t i = 0; i < result.monitor_samples.size(); ++i) {
+                const auto& sample = result.monitor_samples[i];
+                fprintf(
+                    file,
+                    "%s{\"t\":%.3f,\"warm\":%s,\"mbps\":%.3f,\"fps\":%.3f,\"cpu_percent\":%.2f,\"rss_mb\":%.3f,\"gpu_percent\":%.2f}",
+                    i ? "," : "",
+                    sample.elapsed,
+                    sample.warm ? "true" : "false",
+                    sample.mbps,
+                    sample.fps,
+                    sample.usage.cpu_percent,
+                    sample.usage.rss / 1e6,
+                    sample.usage.gpu_percent
+                );
+            }
+            fprintf(file, "]}");
+        }
+        // --compare matches its baseline's runs up with the steps by these.
+        if (!step.empty()) {
+            fprintf(file, ",\"step\":");
+            write_json_string(file, step.c_str());
+        }
+        if (options.runs > 1) {
+            fprintf(file, ",\"iteration\":%zu", iteration);
+        }
+        fprintf(file, "}\n");
+    }
+}
+
+// One combination of the --sweep values.
+struct SweepStep {
+    Options options;
+    // The swept values, e.g. "colors=64 mode=fg".
+    std::string label;
+    // Which of the --runs of this step it is, starting at 0.
+    size_t iteration = 0;
+
+    // The label shown next to the results, which names the run if there are several.
+    std::string title() const {
+        if (options.runs <= 1) {
+            return label;
+        }
+        char run[32];
+        snprintf(&run[0], std::size(run), "run %zu/%zu", iteration + 1, options.runs);
+        return label.empty() ? std::string{&run[0]} : label + ' ' + &run[0];
+    }
+};
+
+// Returns the cartesian product of the --sweep axes, or just the options themselves if nothing is swept.
+static std::vector<SweepStep> build_sweep(const Options& options) {
+    std::vector<SweepStep> steps{{options, {}}};
+    const auto& sweep = options.sweep;
+
+    const auto expand = [&](const auto& values, auto&& apply) {
+        if (values.empty()) {
+            return;
+        }
+        std::vector<SweepStep> expanded;
+        for (const auto& step : steps) {
+            for (const auto& value : values) {
+                auto& next = expanded.emplace_back(step);
+                char label[64];
+                apply(next.options, value, &label[0], std::size(label));
+                if (!next.label.empty()) {
+                    next.label += ' ';
+                }
+                next.label += &label[0];
+            }
+        }
+        steps = std::move(expanded);
+    };
+
+    expand(sweep.colors, [](Options& o, size_t v, char* label, size_t size) {
+        o.num_colors = v;
+        snprintf(label, size, "colors=%zu", v);
+    });
+    expand(sweep.color_modes, [](Options& o, ColorMode v, char* label, size_t size) {
+        o.color_mode = v;
+        snprintf(label, size, "mode=%s", color_mode_name(v));
+    });
+    expand(sweep.glyph_sets, [](Options& o, GlyphSet v, char* label, size_t size) {
+        o.glyph_set = v;
+        snprintf(label, size, "glyphs=%s", glyph_set_name(v));
+    });
+    expand(sweep.sizes, [](Options& o, const std::pair<size_t, size_t>& v, char* label, size_t size) {
+        o.size_override_cols = v.first;
+        o.size_override_rows = v.second;
+        snprintf(label, size, "size=%zux%zu", v.first, v.second);
+    });
+    expand(sweep.unique_glyphs, [](Options& o, size_t v, char* label, size_t size) {
+        o.unique_glyphs = v;
+        snprintf(label, size, "unique=%zu", v);
+    });
+    expand(sweep.attribute_densities, [](Options& o, size_t v, char* label, size_t size) {
+        if (!o.attributes) {
+            o.attributes = Attribute_All;
+        }
+        o.attribute_density = v;
+        snprintf(label, size, "attrs=%zu%%", v);
+    });
+    expand(sweep.syncs, [](Options& o, const std::pair<SyncMode, size_t>& v, char* label, size_t size) {
+        o.sync_mode = v.first;
+        o.sync_batch = v.second;
+        if (v.second > 1) {
+            snprintf(label, size, "sync=%s:%zu", sync_mode_name(v.first), v.second);
+        } else {
+            snprintf(label, size, "sync=%s", sync_mode_name(v.first));
+        }
+    });
+
+    for (auto& step : steps) {
+        build_colors(step.options);
+    }
+    return steps;
+}
+
+// Draws a bar per --sweep step, scaled to the highest throughput in cells/s.
+static void print_sweep_chart(const std::vector<SweepStep>& steps, const std::vector<Result>& results) noexcept {
+    static constexpr int width = 40;
+
+    double best = 0;
+    int label_width = 4;
+    for (size_t i = 0; i < results.size(); ++i) {
+        best = std::max(best, results[i].cells_per_second());
+        label_width = std::max(label_width, static_cast<int>(steps[i].title().size()));
+    }
+
+    fprintf(stderr, "\n%-*s |  Mcells/s |      MB/s |      fps |  p99 ms |\n", label_width, "step");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& result = results[i];
+        const auto cps = result.cells_per_second();
+        const auto bar = best > 0 ? static_cast<int>(cps / best * width + 0.5) : 0;
+        char bars[width + 1];
+        memset(&bars[0], '#', bar);
+        bars[bar] = '\0';
+        fprintf(
+            stderr,
+            "%-*s | %9.2f | %9.3f | %8.1f | %7.2f | %s\n",
+            label_width,
+            steps[i].title().c_str(),
+            cps / 1e6,
+            result.mbps(),
+            result.fps(),
+            result.frame_times.percentile(99) / 1e6,
+            &bars[0]
+        );
+    }
+}
+
+static constexpr std::string_view enter_sequence{
+    "\x1b[?1049h" // enable alternative screen buffer
+    "\x1b[?25l"   // DECTCEM hide cursor
+};
+// --damage=scrollback stays on the main screen buffer, so that the rows scroll into its history.
+static constexpr std::string_view scrollback_enter_sequence{
+    "\x1b[?25l" // DECTCEM hide cursor
+};
+// Start with a fresh line, show cursor again, disable Synchronized Output.
+static constexpr std::string_view leave_sequence{
+    "\x1b[?2026l" // end synchronized update
+    "\x1b[r"      // reset the scrolling region (DECSTBM) of --damage=scroll
+    "\x1b[?25h"   // DECTCEM show cursor
+    "\x1b[?1049l" // disable alternative screen buffer
+};
+static constexpr std::string_view scrollback_leave_sequence{
+    "\x1b[?2026l" // end synchronized update
+    "\x1b[0m\r\n" // SGR reset and a fresh line for the shell
+    "\x1b[?25h"   // DECTCEM show cursor
+};
+
+static std::string_view enter_sequence_for(const Options& options) noexcept {
+    return options.damage_mode == DamageMode_Scrollback ? scrollback_enter_sequence : enter_sequence;
+}
+
+static std::string_view leave_sequence_for(const Options& options) noexcept {
+    return options.damage_mode == DamageMode_Scrollback ? scrollback_leave_sequence : leave_sequence;
+}
+
+// Runs the benchmark as configured until it's interrupted or --duration/--frames have been reached.
+// The console has to be set up by the caller, but terminals given via --stream-ttys are handled here.
+static Result run_benchmark(const Options& options) {
+    Result result;
+    probe.reset();
+    io_counters.reset();
+
+    const auto stream_count = options.stream_count;
+    const auto streams = std::make_unique<Stream[]>(stream_count);
+    for (size_t i = 0; i < stream_count; ++i) {
+        auto& stream = streams[i];
+        stream.index = i;
+        if (!options.stream_ttys.empty()) {
+            stream.tty.mode = SinkMode_Tty;
+            if (!open_sink(stream.tty, options.stream_ttys[i].c_str())) {
+                fprintf(stderr, "failed to open %s\n", options.stream_ttys[i].c_str());
+                for (size_t j = 0; j < i; ++j) {
+                    close_sink(streams[j].tty);
+                }
+                result.interrupted = true;
+                return result;
+            }
+            stream.sink = &stream.tty;
+            write_console(stream.tty, enter_sequence_for(options));
+        }
+        if (options.warmup > 0) {
+            stream.stats.warm.store(false, std::memory_order_relaxed);
+            stream.stats.warmup_end = stream.stats.start + std::chrono::duration_cast<Stats::clock::duration>(std::chrono::duration<double>(options.warmup));
+        }
+    }
+    if (stream_count > 1) {
+        streams[0].peers = {streams.get(), stream_count};
+    }
+
+    if (stream_count == 1) {
+        result.interrupted = run_stream(options, streams[0], [] {
+            return signal_state.exchange(0, std::memory_order_relaxed);
+        });
+    } else {
+        // The main thread turns signals into flags for the stream threads
+        // and each one keeps track of whether it has seen the latest resize.
+        std::atomic<bool> stop{false};
+        std::atomic<uint32_t> resize_epoch{0};
+        std::vector<std::thread> threads;
+
+        for (size_t i = 0; i < stream_count; ++i) {
+            threads.emplace_back([&, i] {
+                uint32_t seen_epoch = 0;
+                run_stream(options, streams[i], [&]() -> uint8_t {
+                    uint8_t state = 0;
+                    if (stop.load(std::memory_order_relaxed)) {
+                        state |= SignalState_Sigint;
+                    }
+                    const auto epoch = resize_epoch.load(std::memory_order_relaxed);
+                    if (epoch != seen_epoch) {
+                        seen_epoch = epoch;
+                        state |= SignalState_Sigwinch;
+                    }
+                    return state;
+                });
+            });
+        }
+
+        for (;;) {
+            const auto state = signal_state.exchange(0, std::memory_order_relaxed);
+            if (state & SignalState_Sigint) {
+                result.interrupted = true;
+                break;
+            }
+            if (state & SignalState_Sigwinch) {
+                resize_epoch.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            bool all_done = true;
+            for (size_t i = 0; i < stream_count; ++i) {
+                all_done &= streams[i].done.load(std::memory_order_relaxed);
+            }
+            if (all_done) {
+                break;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        stop.store(true, std::memory_order_relaxed);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    for (size_t i = 0; i < stream_count; ++i) {
+        if (streams[i].sink == &streams[i].tty) {
+            write_console(streams[i].tty, leave_sequence_for(options));
+            close_sink(streams[i].tty);
+        }
+    }
+
+    auto start = streams[0].stats.start;
+    auto end = streams[0].stats.end;
+    for (size_t i = 0; i < stream_count; ++i) {
+        const auto& stats = streams[i].stats;
+        if (stream_count > 1) {
+            char label[32];
+            snprintf(&label[0], std::size(label), "[%zu] ", i);
+            print_report(&label[0], stats.total_frame_times, stats.total_written, stats.total_cells, std::chrono::duration<double>(stats.end - stats.start).count());
+        }
+        result.add(stats);
+        result.missed_deadlines += streams[i].missed_deadlines.load(std::memory_order_relaxed);
+        result.lateness.merge(streams[i].lateness);
+        result.resize_times.merge(streams[i].resize_latencies);
+        result.resize_timeouts += streams[i].resize_timeouts;
+        result.rebuild_times.merge(streams[i].rebuild_times);
+        result.scrollback_lines += streams[i].scrollback_lines.load(std::memory_order_relaxed);
+        result.replay_loops += streams[i].replay_loops;
+        result.precompute_size += streams[i].precompute_size;
+        result.precomputed &= !streams[i].frame_offsets.empty();
+        result.precompute_backing = streams[i].arena.backing;
+        start = std::min(start, stats.start);
+        end = std::max(end, stats.end);
+    }
+
+    if (options.probe_interval > 0) {
+        const std::lock_guard lock{probe.mutex};
+        probe.total_latencies.merge(probe.latencies);
+        probe.latencies.reset();
+        result.probe_times = probe.total_latencies;
+        result.probe_timeouts = probe.timeouts;
+    }
+
+    const auto accounting = Accounting::now();
+    const auto& run_accounting = streams[0].run_accounting;
+    result.user_time = accounting.cpu.user - run_accounting.cpu.user;
+    result.sys_time = accounting.cpu.sys - run_accounting.cpu.sys;
+    result.blocked_time = (accounting.blocked_ns - run_accounting.blocked_ns) / 1e9;
+    result.accounting_elapsed = std::chrono::duration<double>(accounting.time - run_accounting.time).count();
+
+    result.writes = io_counters.writes.load(std::memory_order_relaxed);
+    result.partial_writes = io_counters.partial_writes.load(std::memory_order_relaxed);
+    result.failed_writes = io_counters.failed_writes.load(std::memory_order_relaxed);
+    result.chunk = streams[0].chunk;
+    result.scrollback_samples = std::move(streams[0].scrollback_samples);
+    result.replay_bytes = replay_file.size;
+    if (streams[0].monitor.pid) {
+        result.terminal_cpu_time = std::max(streams[0].monitor.cpu_seconds() - streams[0].monitor_run_cpu, 0.0);
+        result.monitor_samples = std::move(streams[0].monitor_samples);
+        streams[0].monitor.close();
+    }
+
+    result.elapsed = std::chrono::duration<double>(end - start).count();
+    result.cols = streams[0].screen_cols;
+    result.rows = streams[0].screen_rows;
+    return result;
+}
+
+// Parses durations like "10", "2.5s", "500ms" or "1m" into seconds.
+static double parse_seconds(const char* str) noexcept {
+    char* end;
+    const auto value = strtod(str, &end);
+    if (strcmp(end, "ms") == 0) {
+        return value / 1000;
+    }
+    if (strcmp(end, "m") == 0) {
+        return value * 60;
+    }
+    return value;
+}
+
+// Parses counts like "64", "16K" (16384) or "2G" (2^31).
+static bool parse_count(std::string_view str, size_t& count) noexcept {
+    const auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), count);
+    if (ec != std::errc{} || !count) {
+        return false;
+    }
+    const std::string_view suffix{end, static_cast<size_t>(str.data() + str.size() - end)};
+    if (suffix.empty()) {
+        return true;
+    }
+    if (suffix.size() != 1) {
+        return false;
+    }
+    switch (suffix[0]) {
+    case 'k':
+    case 'K':
+        count <<= 10;
+        return true;
+    case 'm':
+    case 'M':
+        count <<= 20;
+        return true;
+    case 'g':
+    case 'G':
+        count <<= 30;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Calls parse() for each item of the comma-separated list and returns false if any of them fails.
+template<typename Parse>
+static bool parse_list(std::string_view list, Parse&& parse) {
+    while (!list.empty()) {
+        const auto comma = std::min(list.find(','), list.size());
+        if (!parse(list.substr(0, comma))) {
+            return false;
+        }
+        list.remove_prefix(std::min(comma + 1, list.size()));
+    }
+    return true;
+}
+
+// Parses "<mode>[:<n>]" for --sync, where n is the number of frames per synchronized update.
+static bool parse_sync(std::string_view arg, SyncMode& mode, size_t& batch) noexcept {
+    const auto colon = std::min(arg.find(':'), arg.size());
+    const auto name = arg.substr(0, colon);
+    if (name == "2026") {
+        mode = SyncMode_2026;
+    } else if (name == "none") {
+        mode = SyncMode_None;
+    } else if (name == "dcs") {
+        mode = SyncMode_Dcs;
+    } else {
+        return false;
+    }
+    batch = 1;
+    return colon == arg.size() || (parse_count(arg.substr(colon + 1), batch) && batch > 0);
+}
+
+// Parses an integer from 0 to 100.
+static bool parse_percent(std::string_view str, size_t& percent) noexcept {
+    const auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), percent);
+    return ec == std::errc{} && end == str.data() + str.size() && percent <= 100;
+}
+
+// Parses "<attr>,...[:<percent>]" for --attrs, where percent is the share of the cells that carry attributes.
+static bool parse_attributes(std::string_view arg, uint8_t& attributes, size_t& density) {
+    const auto colon = std::min(arg.find(':'), arg.size());
+    attributes = 0;
+    if (colon != arg.size() && !parse_percent(arg.substr(colon + 1), density)) {
+        return false;
+    }
+    return parse_list(arg.substr(0, colon), [&](std::string_view v) {
+        if (v == "all") {
+            attributes |= Attribute_All;
+            return true;
+        }
+        for (size_t k = 0; k < std::size(attribute_names); ++k) {
+            if (v == attribute_names[k]) {
+                attributes |= static_cast<uint8_t>(1 << k);
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+// Parses an "<axis>[:<value>,...]" argument of --sweep. Without values the axis gets its defaults.
+static bool parse_sweep(Sweep& sweep, std::string_view arg) {
+    const auto colon = std::min(arg.find(':'), arg.size());
+    const auto axis = arg.substr(0, colon);
+    const auto values = arg.substr(std::min(colon + 1, arg.size()));
+    const auto has_values = colon < arg.size();
+
+    if (axis == "colors") {
+        sweep.colors.clear();
+        if (!has_values) {
+            // Log-spaced from 1 to max_rainbow_colors.
+            for (size_t n = 1; n < max_rainbow_colors; n *= 2) {
+                sweep.colors.push_back(n);
+            }
+            sweep.colors.push_back(max_rainbow_colors);
+            return true;
+        }
+        return parse_list(values, [&](std::string_view v) {
+            size_t n;
+            if (!parse_count(v, n)) {
+                return false;
+            }
+            sweep.colors.push_back(std::min(n, max_rainbow_colors));
+            return true;
+        });
+    }
+    if (axis == "modes") {
+        sweep.color_modes.clear();
+        return parse_list(has_values ? values : "all,fg,bg,none", [&](std::string_view v) {
+            for (const auto mode : {ColorMode_All, ColorMode_Foreground, ColorMode_Background, ColorMode_None}) {
+                if (v == color_mode_name(mode)) {
+                    sweep.color_modes.push_back(mode);
+                    return true;
+                }
+            }
+            return false;
+        });
+    }
+    if (axis == "glyphs") {
+        sweep.glyph_sets.clear();
+        return parse_list(has_values ? values : "ascii,cjk,combining,emoji,mixed", [&](std::string_view v) {
+            for (const auto set : {GlyphSet_Ascii, GlyphSet_Cjk, GlyphSet_Combining, GlyphSet_Emoji, GlyphSet_Mixed}) {
+                if (v == glyph_set_name(set)) {
+                    sweep.glyph_sets.push_back(set);
+                    return true;
+                }
+            }
+            return false;
+        });
+    }
+    if (axis == "sizes") {
+        sweep.sizes.clear();
+        return parse_list(has_values ? values : "80x24,160x48,320x96", [&](std::string_view v) {
+            const auto x = v.find('x');
+            size_t cols, rows;
+            if (x == std::string_view::npos || !parse_count(v.substr(0, x), cols) || !parse_count(v.substr(x + 1), rows)) {
+                return false;
+            }
+            sweep.sizes.emplace_back(cols, rows);
+            return true;
+        });
+    }
+    if (axis == "attrs") {
+        sweep.attribute_densities.clear();
+        return parse_list(has_values ? values : "0,10,50,100", [&](std::string_view v) {
+            size_t n;
+            if (!parse_percent(v, n)) {
+                return false;
+            }
+            sweep.attribute_densities.push_back(n);
+            return true;
+        });
+    }
+    if (axis == "sync") {
+        sweep.syncs.clear();
+        return parse_list(has_values ? values : "2026,none,dcs,2026:4", [&](std::string_view v) {
+            auto& sync = sweep.syncs.emplace_back();
+            return parse_sync(v, sync.first, sync.second);
+        });
+    }
+    if (axis == "unique-glyphs") {
+        sweep.unique_glyphs.clear();
+        return parse_list(has_values ? values : "64,1K,16K,64K", [&](std::string_view v) {
+            size_t n;
+            if (!parse_count(v, n)) {
+                return false;
+            }
+            sweep.unique_glyphs.push_back(n);
+            return true;
+        });
+    }
+    return false;
+}
+
+// Appends the contents of the file to `contents`.
+static bool read_file(const char* path, std::string& contents) {
+    const auto file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    char chunk[4096];
+    size_t length;
+    while ((length = fread(&chunk[0], 1, std::size(chunk), file)) > 0) {
+        contents.append(&chunk[0], length);
+    }
+    fclose(file);
+    return true;
+}
+
+// Returns the number following `"key":` in the JSON, or 0 if it's missing.
+static double json_number(const std::string& json, const char* key) noexcept {
+    char needle[64];
+    snprintf(&needle[0], std::size(needle), "\"%s\":", key);
+    const auto pos = json.find(&needle[0]);
+    return pos == std::string::npos ? 0 : strtod(json.c_str() + pos + strlen(&needle[0]), nullptr);
+}
+
+// Returns the string following `"key":` in the JSON, or an empty one if it's missing.
+// Escape sequences are kept as is, which is good enough to compare it to what write_json_string() wrote.
+static std::string json_string(std::string_view json, const char* key) {
+    char needle[64];
+    snprintf(&needle[0], std::size(needle), "\"%s\":\"", key);
+    auto beg = json.find(&needle[0]);
+    if (beg == std::string_view::npos) {
+        return {};
+    }
+    beg += strlen(&needle[0]);
+    auto end = beg;
+    while (end < json.size() && json[end] != '"') {
+        end += json[end] == '\\' ? 2 : 1;
+    }
+    return std::string{json.substr(beg, std::min(end, json.size()) - beg)};
+}
+
+// A run out of the --compare baseline: the "step" of its sweep and its throughput.
+struct BaselineRun {
+    std::string step;
+    double fps = 0;
+    double mbps = 0;
+};
+
+// Reads the JSON report of an earlier run, which has one line per step and run.
+static bool load_baseline(const char* path, std::vector<BaselineRun>& runs) {
+    std::string json;
+    if (!read_file(path, json)) {
+        return false;
+    }
+    for (size_t beg = 0; beg < json.size();) {
+        const auto end = std::min(json.find('\n', beg), json.size());
+        const auto line = json.substr(beg, end - beg);
+        beg = end + 1;
+        if (line.find("\"fps\":") == std::string::npos) {
+            continue;
+        }
+        runs.push_back({json_string(line, "step"), json_number(line, "fps"), json_number(line, "mbps")});
+    }
+    return !runs.empty();
+}
+
+// The mean and sample standard deviation of the --runs.
+struct Summary {
+    size_t count = 0;
+    double mean = 0;
+    double stddev = 0;
+
+    explicit Summary(const std::vector<double>& values) noexcept {
+        count = values.size();
+        for (const auto v : values) {
+            mean += v;
+        }
+        mean = count ? mean / count : 0;
+        for (const auto v : values) {
+            stddev += (v - mean) * (v - mean);
+        }
+        stddev = count > 1 ? sqrt(stddev / (count - 1)) : 0;
+    }
+
+    // The squared standard error of the mean.
+    double variance_of_mean() const noexcept {
+        return count ? stddev * stddev / count : 0;
+    }
+};
+
+// Returns the two-sided 95% critical value of Student's t-distribution for the given degrees of freedom.
+static double t_critical(double df) noexcept {
+    static constexpr double table[]{
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+    // Rounding down to a whole degree of freedom errs on the side of "not significant".
+    const auto k = static_cast<size_t>(std::max(1.0, df));
+    return k <= std::size(table) ? table[k - 1] : 1.960;
+}
+
+// Welch's t-test: Returns true if the means of a and b differ at the 95% level.
+// Both need at least 2 runs for their standard deviations to mean anything.
+static bool differs_significantly(const Summary& a, const Summary& b) noexcept {
+    const auto va = a.variance_of_mean();
+    const auto vb = b.variance_of_mean();
+    if (a.count < 2 || b.count < 2 || va + vb <= 0) {
+        return a.count >= 2 && b.count >= 2 && a.mean != b.mean;
+    }
+    const auto df = (va + vb) * (va + vb) / (va * va / (a.count - 1) + vb * vb / (b.count - 1));
+    return fabs(a.mean - b.mean) > t_critical(df) * sqrt(va + vb);
+}
+
+// Prints the mean, standard deviation and 95% confidence interval of the fps and MB/s of each step's --runs,
+// which are consecutive in `results`, and compares them to the baseline if there's one.
+// Returns true if any step has regressed significantly.
+static bool print_run_summary(const Options& options, const std::vector<SweepStep>& steps, const std::vector<Result>& results, const std::vector<BaselineRun>& baseline) {
+    bool regressed = false;
+    for (size_t beg = 0; beg < results.size(); beg += options.runs) {
+        const auto end = std::min(beg + options.runs, results.size());
+        const auto& step = steps[beg].label;
+        char label[96] = "";
+        if (!step.empty()) {
+            snprintf(&label[0], std::size(label), "[%s] ", step.c_str());
+        }
+
+        std::vector<double> fps, mbps, base_fps, base_mbps;
+        for (auto i = beg; i < end; ++i) {
+            fps.push_back(results[i].fps());
+            mbps.push_back(results[i].mbps());
+        }
+        for (const auto& run : baseline) {
+            if (run.step == step) {
+                base_fps.push_back(run.fps);
+                base_mbps.push_back(run.mbps);
+            }
+        }
+
+        const Summary metrics[]{Summary{fps}, Summary{mbps}};
+        const Summary base_metrics[]{Summary{base_fps}, Summary{base_mbps}};
+        static constexpr const char* names[]{"fps", "MB/s"};
+        static constexpr int precisions[]{1, 3};
+
+        for (size_t m = 0; m < 2; ++m) {
+            const auto& sum = metrics[m];
+            const auto p = precisions[m];
+            fprintf(stderr, "%s%s: mean %.*f | stddev %.*f (%.1f%%)", &label[0], names[m], p, sum.mean, p, sum.stddev, sum.mean > 0 ? sum.stddev / sum.mean * 100 : 0);
+            if (sum.count > 1) {
+                const auto ci = t_critical(double(sum.count - 1)) * sqrt(sum.variance_of_mean());
+                fprintf(stderr, " | 95%% CI %.*f to %.*f", p, sum.mean - ci, p, sum.mean + ci);
+            }
+            fprintf(stderr, " | %zu runs\n", sum.count);
+        }
+
+        if (!options.compare_path) {
+            continue;
+        }
+        if (base_fps.empty()) {
+            fprintf(stderr, "%sbaseline: %s has no runs of this step\n", &label[0], options.compare_path);
+            continue;
+        }
+        fprintf(stderr, "%svs baseline:", &label[0]);
+        for (size_t m = 0; m < 2; ++m) {
+            const auto& sum = metrics[m];
+            const auto& base = base_metrics[m];
+            const auto delta = base.mean > 0 ? (sum.mean - base.mean) / base.mean * 100 : 0;
+            const char* verdict = "no significant change";
+            if (sum.count < 2 || base.count < 2) {
+                verdict = "needs 2+ runs on both sides";
+            } else if (differs_significantly(sum, base)) {
+                verdict = sum.mean < base.mean ? "REGRESSION" : "improvement";
+                regressed |= sum.mean < base.mean;
+            }
+            fprintf(stderr, "%s %s %+.1f%% (%s)", m ? " |" : "", names[m], delta, verdict);
+        }
+        fprintf(stderr, " | %zu baseline runs\n", base_fps.size());
+    }
+    return regressed;
+}
+
+// --host: Runs a copy of ourselves with the other arguments as the client of a pseudoconsole (ConPTY
+// on Windows, a pty elsewhere) of the same size as ours and drains its output side as fast as possible.
+// Without a renderer behind it, this measures what the pseudoconsole layer itself can translate.
+// The child reports its own numbers into a temporary file, so that both sides can be compared.
+// Ctrl+C is passed on as a ^C through the input side, which turns it into a SIGINT or CTRL_C_EVENT.
+static int run_host(int argc, const char* argv[], const Options& options) {
+    size_t cols = options.size_override_cols;
+    size_t rows = options.size_override_rows;
+    if (!cols) {
+        query_size(console_sink, cols, rows);
+    }
+
+    char report_path[512];
+#ifdef _WIN32
+    char temp_dir[MAX_PATH];
+    if (!GetTempPathA(MAX_PATH, &temp_dir[0]) || !GetTempFileNameA(&temp_dir[0], "rbb", 0, &report_path[0])) {
+        fprintf(stderr, "--host failed to create a temporary file\n");
+        return 1;
+    }
+#else
+    snprintf(&report_path[0], std::size(report_path), "%s/rainbowbench-XXXXXX", getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    const auto report_fd = mkstemp(&report_path[0]);
+    if (report_fd == -1) {
+        fprintf(stderr, "--host failed to create a temporary file\n");
+        return 1;
+    }
+    close(report_fd);
+#endif
+
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--host") != 0 && !option_value(argv[i], "--report")) {
+            args.emplace_back(argv[i]);
+        }
+    }
+    args.emplace_back(std::string{"--report="} + &report_path[0]);
+
+    static char buffer[1024 * 1024];
+    uint64_t drained = 0;
+    Stats::clock::time_point first, last;
+    const auto drain = [&](size_t length) {
+        last = Stats::clock::now();
+        if (!drained) {
+            first = last;
+        }
+        drained += length;
+    };
+    int exit_code = 1;
+
+#ifdef _WIN32
+#ifdef PROC_THREAD_ATTRIBUTE_PSEUDOCONSOLE
+    SetConsoleCtrlHandler(signalHandler, TRUE);
+
+    HANDLE input_read, input_write, output_read, output_write;
+    if (!CreatePipe(&input_read, &input_write, nullptr, 0) || !CreatePipe(&output_read, &output_write, nullptr, 0)) {
+        fprintf(stderr, "--host failed to create the pipes\n");
+        return 1;
+    }
+    HPCON pseudoconsole;
+    if (FAILED(CreatePseudoConsole({static_cast<SHORT>(cols), static_cast<SHORT>(rows)}, input_read, output_write, 0, &pseudoconsole))) {
+        fprintf(stderr, "--host failed to create a pseudoconsole\n");
+        return 1;
+    }
+    // The pseudoconsole holds onto its own copies.
+    CloseHandle(input_read);
+    CloseHandle(output_write);
+
+    wchar_t path[MAX_PATH];
+    GetModuleFileNameW(nullptr, &path[0], MAX_PATH);
+    std::string narrow;
+    for (const auto& arg : args) {
+        narrow.append(" \"");
+        narrow.append(arg);
+        narrow.append("\"");
+    }
+    std::wstring cmdline;
+    cmdline.append(L"\"");
+    cmdline.append(&path[0]);
+    cmdline.append(L"\"");
+    cmdline.resize(cmdline.size() + narrow.size());
+    const auto converted = MultiByteToWideChar(CP_ACP, 0, narrow.data(), static_cast<int>(narrow.size()), cmdline.data() + cmdline.size() - narrow.size(), static_cast<int>(narrow.size()));
+    cmdline.resize(cmdline.size() - narrow.size() + converted);
+
+    STARTUPINFOEXW si{};
+    si.StartupInfo.cb = sizeof(si);
+    SIZE_T attribute_size = 0;
+    InitializeProcThreadAttributeList(nullptr, 1, 0, &attribute_size);
+    std::vector<std::byte> attributes(attribute_size);
+    si.lpAttributeList = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attributes.data());
+    InitializeProcThreadAttributeList(si.lpAttributeList, 1, 0, &attribute_size);
+    UpdateProcThreadAttribute(si.lpAttributeList, 0, PROC_THREAD_ATTRIBUTE_PSEUDOCONSOLE, pseudoconsole, sizeof(pseudoconsole), nullptr, nullptr);
+
+    PROCESS_INFORMATION pi{};
+    if (!CreateProcessW(&path[0], cmdline.data(), nullptr, nullptr, FALSE, EXTENDED_STARTUPINFO_PRESENT, nullptr, nullptr, &si.StartupInfo, &pi)) {
+        fprintf(stderr, "--host failed to start the client\n");
+        ClosePseudoConsole(pseudoconsole);
+        return 1;
+    }
+    CloseHandle(pi.hThread);
+
+    std::thread reader([&]() noexcept {
+        DWORD read;
+        while (ReadFile(output_read, &buffer[0], sizeof(buffer), &read, nullptr) && read) {
+            drain(read);
+        }
+    });
+    while (WaitForSingleObject(pi.hProcess, 100) != WAIT_OBJECT_0) {
+        if (signal_state.exchange(0, std::memory_order_relaxed) & SignalState_Sigint) {
+            DWORD written;
+            WriteFile(input_write, "\x03", 1, &written, nullptr);
+        }
+    }
+    DWORD code = 1;
+    GetExitCodeProcess(pi.hProcess, &code);
+    exit_code = static_cast<int>(code);
+    CloseHandle(pi.hProcess);
+
+    // The output pipe only ends once the pseudoconsole is gone.
+    ClosePseudoConsole(pseudoconsole);
+    reader.join();
+    CloseHandle(output_read);
+    CloseHandle(input_write);
+#else
+    fprintf(stderr, "--host requires Windows 10 1809 or later (ConPTY)\n");
+    return 1;
+#endif
+#else
+    signal(SIGINT, signalHandler);
+
+    std::vector<char*> child_argv;
+    child_argv.push_back(const_cast<char*>(argv[0]));
+    for (auto& arg : args) {
+        child_argv.push_back(arg.data());
+    }
+    child_argv.push_back(nullptr);
 
-enum SignalState : uint8_t {
-    SignalState_Sigint = 0x1,
-    SignalState_Sigwinch = 0x2,
-};
+    // The child's report goes to our stderr and not through the pty, where no one would see it.
+    const auto stderr_copy = dup(STDERR_FILENO);
+    winsize size{static_cast<unsigned short>(rows), static_cast<unsigned short>(cols), 0, 0};
+    int master;
+    const auto pid = forkpty(&master, nullptr, nullptr, &size);
+    if (pid == -1) {
+        fprintf(stderr, "--host failed to create a pty\n");
+        return 1;
+    }
+    if (pid == 0) {
+        dup2(stderr_copy, STDERR_FILENO);
+        close(stderr_copy);
+        execvp(child_argv[0], child_argv.data());
+        _exit(127);
+    }
+    close(stderr_copy);
 
-enum ColorMode : uint8_t {
-    ColorMode_All = 0,
-    ColorMode_Foreground = 1,
-    ColorMode_Background = 2,
-    ColorMode_None = 3,
-};
+    for (;;) {
+        if (signal_state.exchange(0, std::memory_order_relaxed) & SignalState_Sigint) {
+            write(master, "\x03", 1);
+        }
+        pollfd fd{master, POLLIN, 0};
+        if (poll(&fd, 1, 100) == 0) {
+            continue;
+        }
+        const auto read_bytes = read(master, &buffer[0], sizeof(buffer));
+        if (read_bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        // Linux fails with EIO once the client's side has been closed.
+        if (read_bytes <= 0) {
+            break;
+        }
+        drain(size_t(read_bytes));
+    }
+    close(master);
 
-#ifdef _WIN32
-static const HANDLE consoleHandles[2]{
-    GetStdHandle(STD_INPUT_HANDLE),
-    GetStdHandle(STD_OUTPUT_HANDLE),
-};
+    int status = 0;
+    waitpid(pid, &status, 0);
+    exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
 #endif
 
-static std::atomic<uint8_t> signal_state{SignalState_Sigwinch};
+    std::string child_report;
+    read_file(&report_path[0], child_report);
+    remove(&report_path[0]);
 
-static void write_console(const std::string_view& s) noexcept {
+    const auto elapsed = std::chrono::duration<double>(last - first).count();
+    const auto mbps = elapsed > 0 ? drained / elapsed / 1e6 : 0;
+    const auto child_bytes = json_number(child_report, "bytes");
+    const auto child_mbps = json_number(child_report, "mbps");
+    fprintf(
+        stderr,
+        "host: %.1f MB out of the %s in %.1fs | %.3f MB/s | the client wrote %.1f MB at %.3f MB/s | %.2f bytes out per byte in\n",
+        drained / 1e6,
 #ifdef _WIN32
-    WriteConsoleA(consoleHandles[1], s.data(), s.size(), nullptr, nullptr);
+        "pseudoconsole",
 #else
-    write(STDOUT_FILENO, s.data(), s.size());
+        "pty",
 #endif
-}
+        elapsed,
+        mbps,
+        child_bytes / 1e6,
+        child_mbps,
+        child_bytes > 0 ? drained / child_bytes : 0
+    );
 
-#ifdef _WIN32
-BOOL WINAPI signalHandler(DWORD) {
-    signal_state.fetch_or(SignalState_Sigint, std::memory_order_relaxed);
-    return TRUE;
-}
-#else
-static void signalHandler(int sig) {
-    switch (sig) {
-    case SIGWINCH:
-        signal_state.fetch_or(SignalState_Sigwinch, std::memory_order_relaxed);
-        break;
-    default:
-        signal_state.fetch_or(SignalState_Sigint, std::memory_order_relaxed);
-        break;
+    if (options.report_path) {
+        // The client's report is a single line of JSON, since --host can't be combined with --sweep.
+        const auto client = child_report.empty() ? std::string{"null"} : child_report.substr(0, child_report.find('\n'));
+        if (const auto file = fopen(options.report_path, "w")) {
+            if (options.report_csv) {
+                fprintf(file, "host_bytes,host_mbps,host_duration,client_bytes,client_mbps,client_exit_code,cols,rows\n");
+                fprintf(file, "%" PRIu64 ",%.6f,%.3f,%.0f,%.6f,%d,%zu,%zu\n", drained, mbps, elapsed, child_bytes, child_mbps, exit_code, cols, rows);
+            } else {
+                fprintf(
+                    file,
+                    "{\"host\":{\"bytes\":%" PRIu64 ",\"mbps\":%.6f,\"duration\":%.3f,\"cols\":%zu,\"rows\":%zu},\"client_exit_code\":%d,\"client\":%s}\n",
+                    drained,
+                    mbps,
+                    elapsed,
+                    cols,
+                    rows,
+                    exit_code,
+                    client.c_str()
+                );
+            }
+            fclose(file);
+        } else {
+            fprintf(stderr, "failed to open %s\n", options.report_path);
+        }
     }
+    return exit_code;
 }
-#endif
 
-struct RGB {
-    uint8_t r, g, b;
-};
+static void print_usage() noexcept {
+    fprintf(
+        stderr,
+        "Usage: rainbowbench [options] <num_colors>\n"
+        "\n"
+        "Options:\n"
+        "  -ng                No colors\n"
+        "  -fg                Foreground colors only\n"
+        "  -bg                Background colors only\n"
+        "  -256               Use the xterm-256 palette (38;5;n) instead of 24-bit colors\n"
+        "  -16                Use the 16 color palette (30-37/90-97) instead of 24-bit colors\n"
+        "  -ch=<codepoint>    Draw this specific codepoint only\n"
+        "  --sink=<sink>      Write to: console (default), null, pipe, discard\n"
+        "  --size=<cols>x<rows>\n"
+        "                     Use this frame size instead of the terminal's\n"
+        "  --writev           Submit rows straight from the rainbow buffer via writev()\n"
+        "  --pipeline         Compose frames on the main thread and write them on another\n"
+        "  --chunk=<bytes>|auto\n"
+        "                     Split writes into syscalls of at most this many bytes, e.g. 64K.\n"
+        "                     auto measures 4K to 1M and unlimited for 1s each and keeps the fastest\n"
+        "  --precompute[=<budget>]\n"
+        "                     Render all distinct frames up front and only write() them,\n"
+        "                     if they fit into the budget (default 1G, shared by all streams)\n"
+        "  --streams=<n>      Draw with n threads, each into its own band of rows\n"
+        "  --stream-ttys=<path>,...\n"
+        "                     Give each stream its own terminal instead (e.g. /dev/pts/3)\n"
+        "  --damage=<mode>[:<n>]\n"
+        "                     What each frame redraws: full (default), rows:<n> rows,\n"
+        "                     sparse:<n> random cells, scroll:<n> new lines at the bottom or\n"
+        "                     scrollback[:<n>] new lines on the main screen, filling its history\n"
+        "  --glyphs=<set>     What to draw: ascii (default), cjk (wide), combining (marks),\n"
+        "                     emoji (ZWJ sequences) or mixed (a random mix of them)\n"
+        "  --unique-glyphs=<n>[,<n>...]\n"
+        "                     Spread n distinct glyphs of the set over the screen, e.g. 1K.\n"
+        "                     A list of counts is short for --sweep=unique-glyphs:<list>\n"
+        "  --attrs[=<attr>,...[:<percent>]]\n"
+        "                     Wrap percent (default 25) of the cells in a random mix of the\n"
+        "                     attributes bold, italic, underline (curly), ulcolor (SGR 58) and\n"
+        "                     link (OSC 8, a distinct URL per cell). --attrs alone enables all.\n"
+        "  --sync=<mode>[:<n>]\n"
+        "                     How frames are delimited: 2026 (default, DECSET 2026), dcs (the\n"
+        "                     older DCS =1s/=2s) or none, with n frames per update (default 1)\n"
+        "  --sgr=<mode>       How cells are colored: full (default) repeats the complete SGR\n"
+        "                     sequence for each cell, minimal only emits the colors that changed\n"
+        "  --run=<n>          Give runs of n adjacent cells the same color\n"
+        "  --duration=<time>  Stop after this long, e.g. 10s or 500ms\n"
+        "  --fps=<n>          Pace the frames to this rate and count the missed deadlines\n"
+        "  --resize-storm[=<time>]\n"
+        "                     Resize the terminal this often (default 500ms) and measure the\n"
+        "                     time to the first frame at the new size\n"
+        "  --frames=<n>       Stop after this many frames\n"
+        "  --warmup=<time>    Don't count the frames drawn during this time\n"
+        "  --sweep[=<axis>[:<value>,...]]\n"
+        "                     Run once for every combination of the swept values and chart the\n"
+        "                     results. Axes: colors (log-spaced 1-1530), modes (all,fg,bg,none),\n"
+        "                     glyphs (all sets), sizes (e.g. 80x24, headless sinks recommended),\n"
+        "                     unique-glyphs, sync and attrs (percentages). Repeat to sweep\n"
+        "                     several. --sweep alone sweeps colors and modes. Each step runs\n"
+        "                     1s warmup + 5s unless specified.\n"
+        "  --runs=<n>         Repeat the benchmark (every step of a --sweep) n times and report\n"
+        "                     the mean, stddev and 95%% confidence interval of fps and MB/s\n"
+        "  --cooldown=<time>  Pause between the runs for this long (default 2s)\n"
+        "  --compare=<path>   Compare the runs to a JSON --report of earlier ones with Welch's\n"
+        "                     t-test and exit with status 2 on a significant regression\n"
+        "  --series=<path>|udp://<host>:<port>\n"
+        "                     Stream the stats of every 1s window of every stream into this\n"
+        "                     file, as CSV if it ends in .csv and as InfluxDB line protocol\n"
+        "                     otherwise or over UDP, for soak tests that run for hours\n"
+        "  --report=<path>    Write the results to this file as JSON, or as CSV if it ends\n"
+        "                     in .csv. \"-\" writes JSON to stdout.\n"
+        "  --probe[=<time>]   Measure the terminal's latency by sending a DSR query after\n"
+        "                     a frame every 100ms (default) and timing its reply\n"
+        "  --probe-da1        Query with DA1 instead of DSR\n"
+        "  --replay=<path>    Write this capture of VT output instead of the rainbow, looping\n"
+        "  --replay-frame=<bytes>\n"
+        "                     Split the capture into frames of this size, e.g. 64K, instead\n"
+        "                     of as many lines as the screen has rows\n"
+        "  --record=<path>    Write the exact output of --frames=<n> frames into this file,\n"
+        "                     preceded by the screen size (XTWINOPS), for use with other tools\n"
+        "  --record-direct    Bypass the page cache while recording (O_DIRECT)\n"
+        "  --host             Run as the client of our own pseudoconsole (ConPTY or a pty)\n"
+        "                     and drain it as fast as possible, to measure that layer alone\n"
+        "  --monitor[=<pid>]  Sample the terminal's CPU, RSS and GPU usage once per second\n"
+        "  --terminal-pid=<pid>\n"
+        "                     The terminal process that --monitor and --damage=scrollback\n"
+        "                     sample (default: guessed from the parent processes)\n"
+        "\n"
+    );
+}
 
 int main(int argc, const char* argv[]) {
+#ifdef _WIN32
+    if (argc == 2 && strcmp(argv[1], "--drain") == 0) {
+        return drain_stdin();
+    }
+#endif
+
     const auto help_request = argc >= 2 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0);
-    if (argc > 3 || help_request) {
-        fprintf(
-            stderr,
-            "Usage: rainbowbench [options] <num_colors>\n"
-            "\n"
-            "Options:\n"
-            "  -ng                No colors\n"
-            "  -fg                Foreground colors only\n"
-            "  -bg                Background colors only\n"
-            "  -ch=<codepoint>    Draw this specific codepoint only\n"
-            "\n"
-        );
-        return help_request ? 0 : 1;
+    if (help_request) {
+        print_usage();
+        return 0;
     }
 
-    // HSV offers at most 1530 distinct colors in 8-bit RGB
-    static constexpr size_t max_rainbow_colors = 1530;
-    size_t num_colors = max_rainbow_colors;
-    size_t argv_index = 1;
-    ColorMode color_mode = ColorMode_All;
-    char char_override[4];
-    size_t char_override_length = 0;
+    Options options;
 
-    for (; argv_index < argc; ++argv_index) {
+    for (size_t argv_index = 1; argv_index < size_t(argc); ++argv_index) {
         const auto arg = argv[argv_index];
-        if (strcmp(arg, "-fg") == 0) {
-            color_mode = ColorMode_Foreground;
+        const char* value;
+        if ((value = option_value(arg, "--sink"))) {
+            if (strcmp(value, "console") == 0) {
+                console_sink.mode = SinkMode_Console;
+            } else if (strcmp(value, "null") == 0) {
+                console_sink.mode = SinkMode_Null;
+            } else if (strcmp(value, "pipe") == 0) {
+                console_sink.mode = SinkMode_Pipe;
+            } else if (strcmp(value, "discard") == 0) {
+                console_sink.mode = SinkMode_Discard;
+            } else {
+                print_usage();
+                return 1;
+            }
+        } else if ((value = option_value(arg, "--size"))) {
+            if (sscanf(value, "%zux%zu", &options.size_override_cols, &options.size_override_rows) != 2 || !options.size_override_cols || !options.size_override_rows) {
+                print_usage();
+                return 1;
+            }
+        } else if (strcmp(arg, "--writev") == 0) {
+            options.use_writev = true;
+        } else if (strcmp(arg, "--pipeline") == 0) {
+            options.use_pipeline = true;
+        } else if ((value = option_value(arg, "--streams"))) {
+            options.stream_count = std::clamp<size_t>(strtoull(value, nullptr, 10), 1, 256);
+        } else if ((value = option_value(arg, "--stream-ttys"))) {
+            for (std::string_view list{value}; !list.empty();) {
+                const auto comma = std::min(list.find(','), list.size());
+                options.stream_ttys.emplace_back(list.substr(0, comma));
+                list.remove_prefix(std::min(comma + 1, list.size()));
+            }
+        } else if ((value = option_value(arg, "--damage"))) {
+            const std::string_view v{value};
+            const auto colon = std::min(v.find(':'), v.size());
+            const auto mode = v.substr(0, colon);
+            if (mode == "full") {
+                options.damage_mode = DamageMode_Full;
+            } else if (mode == "rows") {
+                options.damage_mode = DamageMode_Rows;
+            } else if (mode == "sparse") {
+                options.damage_mode = DamageMode_Sparse;
+            } else if (mode == "scroll") {
+                options.damage_mode = DamageMode_Scroll;
+            } else if (mode == "scrollback") {
+                options.damage_mode = DamageMode_Scrollback;
+                // A screenful per frame, unless given.
+                options.damage_count = 0;
+            } else {
+                print_usage();
+                return 1;
+            }
+            if (colon < v.size()) {
+                options.damage_count = std::clamp<size_t>(strtoull(value + colon + 1, nullptr, 10), 1, 1000000);
+            }
+        } else if ((value = option_value(arg, "--glyphs"))) {
+            if (strcmp(value, "ascii") == 0) {
+                options.glyph_set = GlyphSet_Ascii;
+            } else if (strcmp(value, "cjk") == 0) {
+                options.glyph_set = GlyphSet_Cjk;
+            } else if (strcmp(value, "combining") == 0) {
+                options.glyph_set = GlyphSet_Combining;
+            } else if (strcmp(value, "emoji") == 0) {
+                options.glyph_set = GlyphSet_Emoji;
+            } else if (strcmp(value, "mixed") == 0) {
+                options.glyph_set = GlyphSet_Mixed;
+            } else {
+                print_usage();
+                return 1;
+            }
+        } else if ((value = option_value(arg, "--unique-glyphs"))) {
+            // A list of counts is a shorthand for --sweep=unique-glyphs:<list>.
+            const std::string_view v{value};
+            if (v.find(',') != std::string_view::npos) {
+                if (!parse_sweep(options.sweep, std::string{"unique-glyphs:"}.append(v))) {
+                    print_usage();
+                    return 1;
+                }
+            } else if (!parse_count(v, options.unique_glyphs)) {
+                print_usage();
+                return 1;
+            }
+        } else if ((value = option_value(arg, "--chunk"))) {
+            if (strcmp(value, "auto") == 0) {
+                options.chunk_auto = true;
+            } else if (!parse_count(value, options.chunk)) {
+                print_usage();
+                return 1;
+            }
+        } else if (strcmp(arg, "--precompute") == 0) {
+            options.precompute_budget = size_t(1) << 30;
+        } else if ((value = option_value(arg, "--precompute"))) {
+            if (!parse_count(value, options.precompute_budget)) {
+                print_usage();
+                return 1;
+            }
+        } else if (strcmp(arg, "--sweep") == 0) {
+            parse_sweep(options.sweep, "colors");
+            parse_sweep(options.sweep, "modes");
+        } else if ((value = option_value(arg, "--sweep"))) {
+            if (!parse_sweep(options.sweep, value)) {
+                print_usage();
+                return 1;
+            }
+        } else if ((value = option_value(arg, "--sync"))) {
+            if (!parse_sync(value, options.sync_mode, options.sync_batch)) {
+                print_usage();
+                return 1;
+            }
+        } else if (strcmp(arg, "--attrs") == 0) {
+            options.attributes = Attribute_All;
+        } else if ((value = option_value(arg, "--attrs"))) {
+            if (!parse_attributes(value, options.attributes, options.attribute_density)) {
+                print_usage();
+                return 1;
+            }
+        } else if ((value = option_value(arg, "--runs"))) {
+            if (!parse_count(value, options.runs)) {
+                print_usage();
+                return 1;
+            }
+        } else if ((value = option_value(arg, "--cooldown"))) {
+            options.cooldown = parse_seconds(value);
+        } else if ((value = option_value(arg, "--compare"))) {
+            options.compare_path = value;
+        } else if ((value = option_value(arg, "--series"))) {
+            options.series_path = value;
+        } else if ((value = option_value(arg, "--sgr"))) {
+            if (strcmp(value, "full") == 0) {
+                options.sgr_mode = SgrMode_Full;
+            } else if (strcmp(value, "minimal") == 0) {
+                options.sgr_mode = SgrMode_Minimal;
+            } else {
+                print_usage();
+                return 1;
+            }
+        } else if ((value = option_value(arg, "--run"))) {
+            options.run_length = std::clamp<size_t>(strtoull(value, nullptr, 10), 1, 1000);
+        } else if ((value = option_value(arg, "--duration"))) {
+            options.duration = parse_seconds(value);
+        } else if ((value = option_value(arg, "--fps"))) {
+            options.target_fps = std::max(strtod(value, nullptr), 0.0);
+        } else if (strcmp(arg, "--resize-storm") == 0) {
+            options.resize_interval = 0.5;
+        } else if ((value = option_value(arg, "--resize-storm"))) {
+            options.resize_interval = std::max(parse_seconds(value), 0.001);
+        } else if ((value = option_value(arg, "--frames"))) {
+            options.frame_limit = strtoull(value, nullptr, 10);
+        } else if ((value = option_value(arg, "--warmup"))) {
+            options.warmup = parse_seconds(value);
+        } else if ((value = option_value(arg, "--report"))) {
+            const std::string_view path{value};
+            options.report_path = value;
+            options.report_csv = path.size() >= 4 && path.substr(path.size() - 4) == ".csv";
+        } else if (strcmp(arg, "--probe") == 0) {
+            options.probe_interval = 0.1;
+        } else if ((value = option_value(arg, "--probe"))) {
+            options.probe_interval = std::max(parse_seconds(value), 0.001);
+        } else if (strcmp(arg, "--probe-da1") == 0) {
+            options.probe_da1 = true;
+        } else if ((value = option_value(arg, "--replay"))) {
+            options.replay_path = value;
+        } else if ((value = option_value(arg, "--replay-frame"))) {
+            if (!parse_count(value, options.replay_frame)) {
+                print_usage();
+                return 1;
+            }
+        } else if ((value = option_value(arg, "--record"))) {
+            options.record_path = value;
+            console_sink.mode = SinkMode_File;
+        } else if (strcmp(arg, "--record-direct") == 0) {
+            console_sink.direct = true;
+        } else if (strcmp(arg, "--host") == 0) {
+            options.host = true;
+        } else if (strcmp(arg, "--monitor") == 0) {
+            options.monitor = true;
+        } else if ((value = option_value(arg, "--monitor"))) {
+            options.monitor = true;
+            options.terminal_pid = strtol(value, nullptr, 10);
+        } else if ((value = option_value(arg, "--terminal-pid"))) {
+            options.terminal_pid = strtol(value, nullptr, 10);
+        } else if (arg[0] == '-' && arg[1] == '-') {
+            print_usage();
+            return 1;
+        } else if (strcmp(arg, "-fg") == 0) {
+            options.color_mode = ColorMode_Foreground;
         } else if (strcmp(arg, "-bg") == 0) {
-            color_mode = ColorMode_Background;
+            options.color_mode = ColorMode_Background;
+        } else if (strcmp(arg, "-256") == 0) {
+            options.palette = Palette_256;
+        } else if (strcmp(arg, "-16") == 0) {
+            options.palette = Palette_16;
         } else if (strcmp(arg, "-ng") == 0) {
-            color_mode = ColorMode_None;
+            options.color_mode = ColorMode_None;
         } else if (strncmp(arg, "-ch=", 4) == 0) {
             char* endptr;
             const auto codepoint = strtoul(arg + 4, &endptr, 16);
-            if (codepoint < 0x80) {
-                char_override[0] = static_cast<char>(codepoint);
-                char_override_length = 1;
-            } else if (codepoint < 0x800) {
-                char_override[0] = static_cast<char>((0xc0 | (codepoint >> 6)));
-                char_override[1] = static_cast<char>((0x80 | (codepoint & 0x3f)));
-                char_override_length = 2;
-            } else if (codepoint < 0x10000) {
-                char_override[0] = static_cast<char>((0xe0 | (codepoint >> 12)));
-                char_override[1] = static_cast<char>((0x80 | ((codepoint >> 6) & 0x3f)));
-                char_override[2] = static_cast<char>((0x80 | (codepoint & 0x3f)));
-                char_override_length = 3;
-            } else if (codepoint <= 0x110000) {
-                char_override[0] = static_cast<char>((0xf0 | (codepoint >> 18)));
-                char_override[1] = static_cast<char>((0x80 | ((codepoint >> 12) & 0x3f)));
-                char_override[2] = static_cast<char>((0x80 | ((codepoint >> 6) & 0x3f)));
-                char_override[3] = static_cast<char>((0x80 | (codepoint & 0x3f)));
-                char_override_length = 4;
+            if (codepoint <= 0x110000) {
+                options.char_override_length = encode_utf8(&options.char_override[0], static_cast<uint32_t>(codepoint)) - &options.char_override[0];
             }
         } else {
             char* endptr;
-            num_colors = strtoull(arg, &endptr, 10);
-            num_colors = std::clamp<size_t>(num_colors, 1, max_rainbow_colors);
+            options.num_colors = strtoull(arg, &endptr, 10);
+            options.num_colors = std::clamp<size_t>(options.num_colors, 1, max_rainbow_colors);
         }
     }
 
-    std::array<RGB, max_rainbow_colors> colors{};
-    for (size_t i = 0; i < num_colors; ++i) {
-        // https://en.wikipedia.org/wiki/HSL_and_HSV#HSV_to_RGB
-        const auto h = double(i) / double(num_colors) * 360.0;
-        const auto hh = static_cast<int>(h / 60.0);
-        const auto v = static_cast<int>(256.0 / 60.0 * std::fmod(h, 60.0));
-        uint8_t r, g, b;
-
-        switch (hh % 6) {
-        case 0:
-            r = 255;
-            g = v;
-            b = 0;
-            break;
-        case 1:
-            r = 255 - v;
-            g = 255;
-            b = 0;
-            break;
-        case 2:
-            r = 0;
-            g = 255;
-            b = v;
-            break;
-        case 3:
-            r = 0;
-            g = 255 - v;
-            b = 255;
-            break;
-        case 4:
-            r = v;
-            g = 0;
-            b = 255;
-            break;
-        case 5:
-            r = 255;
-            g = 0;
-            b = 255 - v;
-            break;
-        default:
-            std::terminate();
+    if (options.use_writev && options.use_pipeline) {
+        // The pipelined frames need to outlive rebuilds of the rainbow, which writev() can't offer.
+        fprintf(stderr, "--writev and --pipeline are mutually exclusive\n");
+        return 1;
+    }
+    if (!options.stream_ttys.empty()) {
+        options.stream_count = options.stream_ttys.size();
+    }
+    if (options.damage_mode == DamageMode_Scroll && options.stream_count > 1 && options.stream_ttys.empty()) {
+        // The scrolling region is global state and can't be shared between the bands.
+        fprintf(stderr, "--damage=scroll can't be combined with --streams without --stream-ttys\n");
+        return 1;
+    }
+    if (options.damage_mode == DamageMode_Scrollback && options.stream_count > 1 && options.stream_ttys.empty()) {
+        // The rows always scroll the entire screen.
+        fprintf(stderr, "--damage=scrollback can't be combined with --streams without --stream-ttys\n");
+        return 1;
+    }
+    if ((options.damage_mode == DamageMode_Scrollback || options.monitor) && !options.terminal_pid) {
+        options.terminal_pid = find_terminal_pid();
+    }
+    if (options.monitor) {
+        ProcessMonitor monitor;
+        const auto ok = options.terminal_pid && monitor.open(options.terminal_pid);
+        monitor.close();
+        if (!ok) {
+            fprintf(stderr, "--monitor couldn't find or open the terminal process, pass its pid with --monitor=<pid>\n");
+            return 1;
         }
+    }
 
-        colors[i] = {r, g, b};
+    if (options.precompute_budget && (options.use_writev || options.use_pipeline || options.damage_mode != DamageMode_Full)) {
+        fprintf(stderr, "--precompute requires --damage=full and can't be combined with --writev or --pipeline\n");
+        return 1;
+    }
+    if (options.resize_interval > 0 && options.use_pipeline) {
+        // The first frame after a resize has to be written by the thread that noticed the resize.
+        fprintf(stderr, "--resize-storm can't be combined with --pipeline\n");
+        return 1;
+    }
+    if (options.probe_da1 && options.probe_interval <= 0) {
+        options.probe_interval = 0.1;
+    }
+    if (options.probe_interval > 0 && (console_sink.mode != SinkMode_Console || !options.stream_ttys.empty())) {
+        // The replies arrive on our stdin, which is only the case for the console itself.
+        fprintf(stderr, "--probe requires --sink=console and can't be combined with --stream-ttys\n");
+        return 1;
     }
 
-    size_t screen_cols = 0;
-    size_t screen_rows = 0;
-    size_t screen_area = 0;
-    std::string rainbow;
-    std::vector<size_t> rainbow_indices;
+    if ((!options.sweep.empty() || options.runs > 1 || options.compare_path) && options.duration <= 0 && !options.frame_limit) {
+        // Each step of the sweep and each run needs to end on its own.
+        options.duration = 5;
+        if (options.warmup <= 0) {
+            options.warmup = 1;
+        }
+    }
 
-    const auto rebuild_rainbow = [&]() {
-        screen_area = screen_cols * screen_rows;
+    if (options.replay_path) {
+        if (options.use_writev || options.use_pipeline || options.precompute_budget || (options.stream_count > 1 && options.stream_ttys.empty())) {
+            // The capture is written as is, so there's nothing to compose, and it assumes the entire screen.
+            fprintf(stderr, "--replay can't be combined with --writev, --pipeline, --precompute or --streams without --stream-ttys\n");
+            return 1;
+        }
+        if (!replay_file.open(options.replay_path)) {
+            fprintf(stderr, "failed to map %s\n", options.replay_path);
+            return 1;
+        }
+    }
 
-        const auto fg_offset = std::max<size_t>(1, (num_colors + 5) / 10);
-        char buffer[64];
+    if (options.record_path) {
+        // The recording must only depend on the options, not on timing or on a second thread,
+        // which rules out everything that reacts to the clock. The status row stays empty.
+        if (!options.frame_limit || options.duration > 0 || options.warmup > 0 || options.stream_count > 1 || !options.sweep.empty() || options.chunk_auto ||
+            options.resize_interval > 0 || options.probe_interval > 0 || options.host || options.monitor || options.runs > 1 || options.compare_path) {
+            fprintf(stderr, "--record requires --frames and can't be combined with --duration, --warmup, --streams, --sweep, --chunk=auto, --resize-storm, --probe, --host, --monitor, --runs or --compare\n");
+            return 1;
+        }
+        if (!options.size_override_cols) {
+            query_size(console_sink, options.size_override_cols, options.size_override_rows);
+        }
+    }
 
-        for (size_t i = 0, count = num_colors + screen_cols; i < count; ++i) {
-            // Using ▀ would be graphically more pleasing, but in this benchmark
-            // we want to test rendering performance and DirectWrite, as used
-            // in Windows Terminal, has a very poor font-fallback performance.
-            // If we were to use ▀, we'd primarily test how fast DirectWrite is.
-            int length = 0;
-            switch (color_mode) {
-            case ColorMode_All: {
-                const auto bg = colors[i % num_colors];
-                const auto fg = colors[(i + fg_offset) % num_colors];
-                length = snprintf(buffer, std::ssize(buffer), "\x1b[48;2;%d;%d;%d;38;2;%d;%d;%dm", bg.r, bg.g, bg.b, fg.r, fg.g, fg.b);
-                break;
-            }
-            case ColorMode_Foreground: {
-                const auto fg = colors[i % num_colors];
-                length = snprintf(buffer, std::ssize(buffer), "\x1b[38;2;%d;%d;%dm", fg.r, fg.g, fg.b);
-                break;
-            }
-            case ColorMode_Background: {
-                const auto bg = colors[i % num_colors];
-                length = snprintf(buffer, std::ssize(buffer), "\x1b[48;2;%d;%d;%dm", bg.r, bg.g, bg.b);
-                break;
-            }
-            default:
-                break;
-            }
+    std::vector<BaselineRun> baseline;
+    if (options.compare_path && !load_baseline(options.compare_path, baseline)) {
+        fprintf(stderr, "failed to read the JSON report %s\n", options.compare_path);
+        return 1;
+    }
 
-            rainbow_indices.push_back(rainbow.size());
-            rainbow.append(buffer, length);
+    if (options.series_path && !options.host && !series.open(options.series_path)) {
+        fprintf(stderr, "failed to open %s for --series\n", options.series_path);
+        return 1;
+    }
 
-            if (char_override_length) {
-                rainbow.append(&char_override[0], char_override_length);
-            } else {
-                rainbow.push_back(static_cast<char>('!' + i % 94));
+    if (options.host) {
+        if (console_sink.mode != SinkMode_Console || !options.stream_ttys.empty() || !options.sweep.empty() || options.probe_interval > 0 || options.monitor ||
+            options.runs > 1 || options.compare_path) {
+            // The client draws into the pseudoconsole as its console. Nobody there answers queries.
+            fprintf(stderr, "--host requires --sink=console and can't be combined with --stream-ttys, --sweep, --probe, --monitor, --runs or --compare\n");
+            return 1;
+        }
+        return run_host(argc, argv, options);
+    }
+
+    auto steps = build_sweep(options);
+    if (options.runs > 1) {
+        std::vector<SweepStep> repeated;
+        for (const auto& step : steps) {
+            for (size_t i = 0; i < options.runs; ++i) {
+                repeated.emplace_back(step).iteration = i;
             }
         }
-    };
+        steps = std::move(repeated);
+    }
+    for (const auto& step : steps) {
+        const auto& o = step.options;
+        if (o.unique_glyphs && (o.char_override_length || o.unique_glyphs > glyph_set_size(o.glyph_set))) {
+            const auto available = o.char_override_length ? size_t(1) : glyph_set_size(o.glyph_set);
+            fprintf(stderr, "--unique-glyphs=%zu exceeds the %zu glyphs of --glyphs=%s\n", o.unique_glyphs, available, glyph_set_name(o.glyph_set));
+            return 1;
+        }
+    }
 
 #ifdef _WIN32
     const auto previousCP = GetConsoleOutputCP();
@@ -241,6 +5154,10 @@ int main(int argc, const char* argv[]) {
         GetConsoleMode(consoleHandles[i], &previousModes[i]);
         SetConsoleMode(consoleHandles[i], previousModes[i] | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
     }
+    if (options.probe_interval > 0) {
+        // Makes the replies to the --probe queries show up as key events.
+        SetConsoleMode(consoleHandles[0], (previousModes[0] | ENABLE_VIRTUAL_TERMINAL_INPUT) & ~(ENABLE_LINE_INPUT | ENABLE_ECHO_INPUT));
+    }
 
     SetConsoleCtrlHandler(signalHandler, TRUE);
 
@@ -259,6 +5176,12 @@ int main(int argc, const char* argv[]) {
                     if (records[i].EventType == WINDOW_BUFFER_SIZE_EVENT) {
                         signal_state.fetch_or(SignalState_Sigwinch, std::memory_order_relaxed);
                     }
+                    // The replies are pure ASCII, so anything else can be ignored.
+                    const auto& key = records[i].Event.KeyEvent;
+                    if (records[i].EventType == KEY_EVENT && key.bKeyDown && key.uChar.UnicodeChar && key.uChar.UnicodeChar < 0x80) {
+                        const auto ch = static_cast<char>(key.uChar.UnicodeChar);
+                        probe.parse(&ch, 1);
+                    }
                 }
             }
             return 0;
@@ -270,97 +5193,98 @@ int main(int argc, const char* argv[]) {
 #else
     signal(SIGINT, signalHandler);
     signal(SIGWINCH, signalHandler);
-#endif
+    signal(SIGPIPE, SIG_IGN);
 
-    write_console(
-        "\x1b[?1049h" // enable alternative screen buffer
-        "\x1b[?25l"   // DECTCEM hide cursor
-    );
-
-    float mbps = 0;
-    float frames = 0;
-    size_t written = 0;
-    size_t frame = 0;
-    auto reference = std::chrono::steady_clock::now();
-    std::string output;
-    char statsBuffer[128];
-    size_t statsLength = 0;
+    // The replies to the --probe queries need stdin in non-canonical mode without echo. ISIG is
+    // kept, so that Ctrl+C still works. The 100ms poll timeout lets the reader notice the end of the run.
+    termios previous_termios{};
+    std::atomic<bool> stop_reader{false};
+    std::thread reader;
+    if (options.probe_interval > 0 && tcgetattr(STDIN_FILENO, &previous_termios) == 0) {
+        auto t = previous_termios;
+        t.c_lflag &= ~(ICANON | ECHO);
+        t.c_cc[VMIN] = 1;
+        t.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &t);
 
-    for (size_t i = 0;; ++i) {
-        const auto state = signal_state.exchange(0, std::memory_order_relaxed);
-        if (state & SignalState_Sigint) {
-            break;
-        }
-        if (state & SignalState_Sigwinch) {
-#ifdef _WIN32
-            CONSOLE_SCREEN_BUFFER_INFO info{};
-            GetConsoleScreenBufferInfo(consoleHandles[1], &info);
-            screen_cols = info.dwSize.X;
-            screen_rows = info.dwSize.Y;
-            rebuild_rainbow();
-#else
-            winsize size{};
-            ioctl(STDOUT_FILENO, TIOCGWINSZ, &size);
-            screen_cols = size.ws_col;
-            screen_rows = size.ws_row;
-            rebuild_rainbow();
+        reader = std::thread([&]() noexcept {
+            char buffer[256];
+            while (!stop_reader.load(std::memory_order_relaxed)) {
+                pollfd fd{STDIN_FILENO, POLLIN, 0};
+                if (poll(&fd, 1, 100) <= 0) {
+                    continue;
+                }
+                const auto read_bytes = read(STDIN_FILENO, &buffer[0], std::size(buffer));
+                if (read_bytes <= 0) {
+                    break;
+                }
+                probe.parse(&buffer[0], static_cast<size_t>(read_bytes));
+            }
+        });
+    }
 #endif
-        }
 
-        statsLength = sprintf(&statsBuffer[0], "%.1f fps | %.3f MB/s", frames, mbps);
-        statsLength = std::min(statsLength, screen_cols);
+    if (!open_sink(console_sink, options.record_path)) {
+        fprintf(stderr, "failed to open the output sink\n");
+        return 1;
+    }
 
-        output.clear();
-        output.append(
-            "\033[?2026h" // begin synchronized update
-            "\x1b[H"      // Cursor Position (CUP)
-            "\x1b[39;49m" // Foreground/Background color reset (part of SGR)
-        );
-        output.append(&statsBuffer[0], statsLength);
+    std::vector<Result> results;
 
-        {
-            const auto idx = (i + statsLength) % num_colors;
-            const auto beg = rainbow_indices[idx];
-            const auto end = rainbow_indices[idx + screen_cols - statsLength];
-            const auto count = end - beg;
-            output.append(rainbow.data() + beg, count);
+    if (options.record_path) {
+        // XTWINOPS: Resize the text area, so that the recording plays back at the size it was made for.
+        char size[32];
+        const auto length = snprintf(&size[0], std::size(size), "\x1b[8;%zu;%zut", options.size_override_rows, options.size_override_cols);
+        write_console({&size[0], static_cast<size_t>(length)});
+    }
+    if (options.series_path) {
+        series.start();
+    }
+    write_console(enter_sequence_for(options));
+    for (const auto& step : steps) {
+        if (step.iteration && options.cooldown > 0) {
+            // Let the terminal, the compositor and the CPU's clocks settle between the runs.
+            const auto until = Stats::clock::now() + std::chrono::duration_cast<Stats::clock::duration>(std::chrono::duration<double>(options.cooldown));
+            while (!(signal_state.load(std::memory_order_relaxed) & SignalState_Sigint) && Stats::clock::now() < until) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
         }
-
-        for (size_t y = 1; y < screen_rows; ++y) {
-            const auto idx = (i + y * 2) % num_colors;
-            const auto beg = rainbow_indices[idx];
-            const auto end = rainbow_indices[idx + screen_cols];
-            const auto count = end - beg;
-            output.append(rainbow.data() + beg, count);
+        results.push_back(run_benchmark(step.options));
+        if (results.back().interrupted) {
+            break;
         }
-
-        output.append(
-            "\033[?2026l" // end synchronized update
+    }
+    write_console(leave_sequence_for(options));
+    close_sink(console_sink);
+    replay_file.close();
+    series.close();
+    if (options.record_path) {
+        fprintf(
+            stderr,
+            "recorded %.1f MB at %zux%zu into %s%s\n",
+            file_buffer.total / 1e6,
+            options.size_override_cols,
+            options.size_override_rows,
+            options.record_path,
+            console_sink.direct ? " (direct I/O)" : ""
         );
+    }
 
-        write_console(output);
-
-        written += output.size();
-        frame++;
-
-        const auto now = std::chrono::steady_clock::now();
-        const auto duration = now - reference;
-        if (duration >= std::chrono::seconds(1)) {
-            const auto durationCount = std::chrono::duration<float>(duration).count();
-            mbps = written / durationCount / 1e6f;
-            frames = frame / durationCount;
-            reference = now;
-            written = 0;
-            frame = 0;
+#ifndef _WIN32
+    if (reader.joinable()) {
+        // Give the reply to the last query a moment to arrive, so it doesn't end up in the shell.
+        for (int i = 0; i < 100 && probe.sent.load(std::memory_order_relaxed); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
         }
+        stop_reader.store(true, std::memory_order_relaxed);
+        reader.join();
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &previous_termios);
     }
+#endif
 
-    // Start with a fresh line, show cursor again, disable Synchronized Output.
-    write_console(
-        "\x1b[?2026l" // end synchronized update
-        "\x1b[?25h"   // DECTCEM show cursor
-        "\x1b[?1049l" // disable alternative screen buffer
-    );
+    if (console_sink.mode != SinkMode_Console) {
+        fprintf(stderr, "\n");
+    }
 
 #ifdef _WIN32
     SetConsoleOutputCP(previousCP);
@@ -369,4 +5293,143 @@ int main(int argc, const char* argv[]) {
         SetConsoleMode(consoleHandles[i], previousModes[i]);
     }
 #endif
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& result = results[i];
+        char label[96] = "";
+        if (steps.size() > 1) {
+            snprintf(&label[0], std::size(label), "[%s] ", steps[i].title().c_str());
+        }
+        print_report(&label[0], result.frame_times, result.written, result.cells, result.elapsed);
+        if (options.probe_interval > 0) {
+            char latencies[128];
+            format_latencies(&latencies[0], std::size(latencies), result.probe_times);
+            fprintf(stderr, "%sprobe latency: %s | %" PRIu64 " replies | %zu timeouts\n", &label[0], &latencies[0], result.probe_times.count, result.probe_timeouts);
+        }
+        if (options.target_fps > 0) {
+            char lateness[128];
+            format_latencies(&lateness[0], std::size(lateness), result.lateness);
+            fprintf(stderr, "%spacing: %.1f fps target | %zu missed deadlines | lateness %s\n", &label[0], options.target_fps, result.missed_deadlines, &lateness[0]);
+        }
+        if (options.resize_interval > 0) {
+            char latencies[128];
+            format_latencies(&latencies[0], std::size(latencies), result.resize_times);
+            fprintf(stderr, "%sresizes: %" PRIu64 " answered | %zu unanswered | first frame %s\n", &label[0], result.resize_times.count, result.resize_timeouts, &latencies[0]);
+        }
+        if (result.rebuild_times.count > 1) {
+            char latencies[128];
+            format_latencies(&latencies[0], std::size(latencies), result.rebuild_times);
+            fprintf(stderr, "%srebuilds: %" PRIu64 " | %s\n", &label[0], result.rebuild_times.count, &latencies[0]);
+        }
+        if (options.damage_mode == DamageMode_Scrollback) {
+            if (options.terminal_pid) {
+                fprintf(stderr, "%sscrollback: %zu rows | terminal pid %ld\n", &label[0], result.scrollback_lines, options.terminal_pid);
+            } else {
+                fprintf(stderr, "%sscrollback: %zu rows | terminal unknown\n", &label[0], result.scrollback_lines);
+            }
+            for (const auto& sample : result.scrollback_samples) {
+                fprintf(stderr, "%s  %7.1fs | %10zu rows | %9.3f MB/s", &label[0], sample.elapsed, sample.lines, sample.mbps);
+                if (sample.terminal_rss) {
+                    fprintf(stderr, " | RSS %.1f MB", sample.terminal_rss / 1e6);
+                }
+                fprintf(stderr, "\n");
+            }
+        }
+        if (result.accounting_elapsed > 0) {
+            const auto wall = result.accounting_elapsed;
+            fprintf(
+                stderr,
+                "%scpu: %.1f%% user | %.1f%% sys | %.1f%% blocked in %" PRIu64 " writes (%.1f per frame)\n",
+                &label[0],
+                result.user_time / wall * 100,
+                result.sys_time / wall * 100,
+                result.blocked_time / wall * 100,
+                result.writes,
+                result.frame_times.count ? double(result.writes) / double(result.frame_times.count) : 0
+            );
+        }
+        if (options.replay_path) {
+            fprintf(
+                stderr,
+                "%sreplay: %s | %.1f MB | written %.2f times (%zu loops)\n",
+                &label[0],
+                options.replay_path,
+                result.replay_bytes / 1e6,
+                double(result.written) / double(result.replay_bytes),
+                result.replay_loops
+            );
+        }
+        if (options.monitor) {
+            const auto wall = result.accounting_elapsed > 0 ? result.accounting_elapsed : 1;
+            const auto gpu = result.terminal_gpu_percent();
+            fprintf(
+                stderr,
+                "%sterminal: pid %ld | cpu %.1f%% (%.2f ms/MB) | RSS peak %.1f MB",
+                &label[0],
+                options.terminal_pid,
+                result.terminal_cpu_time / wall * 100,
+                result.terminal_cpu_ms_per_mb(),
+                result.terminal_rss_peak() / 1e6
+            );
+            if (gpu >= 0) {
+                fprintf(stderr, " | gpu %.1f%%", gpu);
+            }
+            fprintf(stderr, "\n");
+        }
+        if (options.chunk || options.chunk_auto || result.partial_writes || result.failed_writes) {
+            char chunk[32];
+            format_chunk(chunk, result.chunk);
+            fprintf(
+                stderr,
+                "%swrites: %" PRIu64 " syscalls | %" PRIu64 " partial | %" PRIu64 " failed | chunk %s%s\n",
+                &label[0],
+                result.writes,
+                result.partial_writes,
+                result.failed_writes,
+                &chunk[0],
+                options.chunk_auto ? " (auto)" : ""
+            );
+        }
+        if (options.precompute_budget) {
+            const auto mb = result.precompute_size / 1e6;
+            if (result.precomputed) {
+                fprintf(stderr, "%sprecomputed frames: %.1f MB (%s)\n", &label[0], mb, result.precompute_backing);
+            } else {
+                fprintf(stderr, "%sprecomputed frames: %.1f MB exceed the %.1f MB budget, sliced them instead\n", &label[0], mb, options.precompute_budget / 1e6);
+            }
+        }
+    }
+    if (steps.size() > 1) {
+        print_sweep_chart(steps, results);
+    }
+    if (options.series_path) {
+        fprintf(stderr, "series: %zu samples to %s", series.written, options.series_path);
+        if (const auto dropped = series_ring.dropped.load(std::memory_order_relaxed)) {
+            fprintf(stderr, " | %zu dropped", dropped);
+        }
+        fprintf(stderr, "\n");
+    }
+    auto regressed = false;
+    if (options.runs > 1 || options.compare_path) {
+        fprintf(stderr, "\n");
+        regressed = print_run_summary(options, steps, results, baseline);
+    }
+
+    if (options.report_path) {
+        const auto to_stdout = strcmp(options.report_path, "-") == 0;
+        const auto file = to_stdout ? stdout : fopen(options.report_path, "w");
+        auto ok = file != nullptr;
+        if (ok) {
+            for (size_t i = 0; i < results.size(); ++i) {
+                write_report(file, steps[i].options, results[i], i == 0, steps[i].label, steps[i].iteration);
+            }
+            ok = to_stdout ? fflush(file) == 0 : fclose(file) == 0;
+        }
+        if (!ok) {
+            fprintf(stderr, "failed to write the report to %s\n", options.report_path);
+            return 1;
+        }
+    }
+    // Lets scripts gating on --compare tell a regression apart from a failure to run.
+    return regressed ? 2 : 0;
 }